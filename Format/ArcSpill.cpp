@@ -0,0 +1,341 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "ArcSpill.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <algorithm>
+
+ArcSpill::ArcSpill()
+{
+    m_bufferEntries = 0;
+    m_bufferPos = 0;
+    m_hasPending = false;
+    m_bufferOnly = false;
+    m_failed = false;
+}
+
+ArcSpill::~ArcSpill()
+{
+    Clear();
+}
+
+void ArcSpill::Clear()
+{
+    CloseReaders();
+
+    // temporary files are deleted once closed
+    for (size_t level = 0; level < m_levels.size(); level++)
+    {
+        for (size_t i = 0; i < m_levels[level].size(); i++)
+            fclose(m_levels[level][i]);
+    }
+    m_levels.clear();
+
+    // keep buffer capacity for next load
+    m_buffer.clear();
+    m_bufferPos = 0;
+    m_hasPending = false;
+    m_bufferOnly = false;
+    m_failed = false;
+}
+
+void ArcSpill::Begin(size_t bufferEntries)
+{
+    Clear();
+
+    m_bufferEntries = nmax(bufferEntries, (size_t)ARC_SPILL_MIN_BLOCK);
+    m_buffer.reserve(m_bufferEntries);
+}
+
+bool ArcSpill::Add(const callsite_arc &site)
+{
+    m_buffer.push_back(site);
+
+    if (m_buffer.size() >= m_bufferEntries)
+        return SpillBuffer();
+
+    return true;
+}
+
+void ArcSpill::SortBuffer(std::vector<callsite_arc> &buffer)
+{
+    size_t i, last;
+
+    std::sort(buffer.begin(), buffer.end(), CallSiteSortPredicate());
+
+    // merge duplicates, so the runs are as short as possible
+    last = 0;
+    for (i = 1; i < buffer.size(); i++)
+    {
+        if (buffer[i].caller == buffer[last].caller && buffer[i].offset == buffer[last].offset && buffer[i].callee == buffer[last].callee)
+            buffer[last].count += buffer[i].count;
+        else
+            buffer[++last] = buffer[i];
+    }
+
+    if (!buffer.empty())
+        buffer.resize(last + 1);
+}
+
+bool ArcSpill::SpillBuffer()
+{
+    SortBuffer(m_buffer);
+
+    FILE* run = tmpfile();
+    if (!run)
+    {
+        LogFunc(LOG_ERROR, "Could not create temporary file for call graph arcs");
+        m_failed = true;
+        return false;
+    }
+
+    if (!m_buffer.empty() && fwrite(&m_buffer[0], sizeof(callsite_arc), m_buffer.size(), run) != m_buffer.size())
+    {
+        LogFunc(LOG_ERROR, "Could not write call graph arcs to temporary file");
+        fclose(run);
+        m_failed = true;
+        return false;
+    }
+
+    LogGated(LOG_DEBUG, "Spilled run of %llu call sites to temporary file", (unsigned long long)m_buffer.size());
+
+    if (m_levels.empty())
+        m_levels.resize(1);
+
+    m_levels[0].push_back(run);
+    m_buffer.clear();
+
+    // keep count of open temporary files bounded
+    if (m_levels[0].size() >= ARC_SPILL_MERGE_FANIN)
+        return MergeLevel(0);
+
+    return true;
+}
+
+bool ArcSpill::ReaderAfter(uint32_t a, uint32_t b) const
+{
+    const run_reader &ra = m_readers[a];
+    const run_reader &rb = m_readers[b];
+
+    return CallSiteSortPredicate()(rb.block[rb.pos], ra.block[ra.pos]);
+}
+
+bool ArcSpill::OpenReaders(const std::vector<FILE*> &runs)
+{
+    CloseReaders();
+
+    // readers share the same amount of memory as the buffer has
+    size_t blockEntries = nmax(m_bufferEntries / nmax(runs.size(), (size_t)1), (size_t)ARC_SPILL_MIN_BLOCK);
+
+    m_readers.resize(runs.size());
+    for (size_t i = 0; i < runs.size(); i++)
+    {
+        run_reader &reader = m_readers[i];
+
+        reader.file = runs[i];
+        reader.block.resize(blockEntries);
+        rewind(reader.file);
+
+        if (FillReader(reader))
+            m_heap.push_back((uint32_t)i);
+    }
+
+    std::make_heap(m_heap.begin(), m_heap.end(), [this](uint32_t a, uint32_t b) { return ReaderAfter(a, b); });
+
+    return !m_failed;
+}
+
+bool ArcSpill::FillReader(run_reader &reader)
+{
+    reader.pos = 0;
+    reader.count = fread(&reader.block[0], sizeof(callsite_arc), reader.block.size(), reader.file);
+
+    if (reader.count == 0 && ferror(reader.file))
+    {
+        LogFunc(LOG_ERROR, "Could not read call graph arcs from temporary file");
+        m_failed = true;
+    }
+
+    return reader.count > 0;
+}
+
+void ArcSpill::CloseReaders()
+{
+    // run files are owned by run list, readers just refer to them
+    m_readers.clear();
+    m_heap.clear();
+}
+
+bool ArcSpill::NextMerged(callsite_arc &site)
+{
+    // nothing was spilled, the whole input is in (sorted) buffer
+    if (m_bufferOnly)
+    {
+        if (m_bufferPos >= m_buffer.size())
+            return false;
+
+        site = m_buffer[m_bufferPos++];
+        return true;
+    }
+
+    if (m_heap.empty())
+        return false;
+
+    auto after = [this](uint32_t a, uint32_t b) { return ReaderAfter(a, b); };
+
+    // take the lowest call site, and put its reader back to heap with the next one
+    std::pop_heap(m_heap.begin(), m_heap.end(), after);
+
+    run_reader &reader = m_readers[m_heap.back()];
+    site = reader.block[reader.pos++];
+
+    if (reader.pos < reader.count || FillReader(reader))
+        std::push_heap(m_heap.begin(), m_heap.end(), after);
+    else
+        m_heap.pop_back();
+
+    return true;
+}
+
+bool ArcSpill::Next(callsite_arc &site)
+{
+    if (!m_hasPending)
+    {
+        if (!NextMerged(m_pending))
+            return false;
+    }
+
+    site = m_pending;
+
+    // duplicates from different runs follow right after each other
+    while ((m_hasPending = NextMerged(m_pending)) && m_pending.caller == site.caller && m_pending.offset == site.offset
+        && m_pending.callee == site.callee)
+    {
+        site.count += m_pending.count;
+    }
+
+    return true;
+}
+
+bool ArcSpill::MergeLevel(size_t level)
+{
+    std::vector<FILE*> runs;
+    runs.swap(m_levels[level]);
+
+    FILE* run = tmpfile();
+    if (!run)
+    {
+        LogFunc(LOG_ERROR, "Could not create temporary file for call graph arcs");
+        m_failed = true;
+    }
+
+    callsite_arc site;
+    uint64_t count = 0;
+
+    if (run && OpenReaders(runs))
+    {
+        m_hasPending = false;
+        while (Next(site))
+        {
+            if (fwrite(&site, sizeof(callsite_arc), 1, run) != 1)
+            {
+                LogFunc(LOG_ERROR, "Could not write call graph arcs to temporary file");
+                m_failed = true;
+                break;
+            }
+            count++;
+        }
+    }
+
+    CloseReaders();
+    m_hasPending = false;
+
+    for (size_t i = 0; i < runs.size(); i++)
+        fclose(runs[i]);
+
+    if (m_failed)
+    {
+        if (run)
+            fclose(run);
+        return false;
+    }
+
+    LogGated(LOG_DEBUG, "Merged %llu runs of level %llu to single run of %llu call sites", (unsigned long long)runs.size(),
+        (unsigned long long)level, (unsigned long long)count);
+
+    if (m_levels.size() <= level + 1)
+        m_levels.resize(level + 2);
+
+    m_levels[level + 1].push_back(run);
+
+    if (m_levels[level + 1].size() >= ARC_SPILL_MERGE_FANIN)
+        return MergeLevel(level + 1);
+
+    return true;
+}
+
+bool ArcSpill::StartMerge()
+{
+    if (m_failed)
+        return false;
+
+    m_bufferPos = 0;
+    m_hasPending = false;
+
+    // everything fits to memory, just sort the buffer
+    if (m_levels.empty())
+    {
+        m_bufferOnly = true;
+        SortBuffer(m_buffer);
+        return true;
+    }
+
+    // the rest of buffer becomes the last run
+    if (!m_buffer.empty() && !SpillBuffer())
+        return false;
+
+    // the final merge reads runs left at all levels at once
+    std::vector<FILE*> runs;
+    for (size_t level = 0; level < m_levels.size(); level++)
+        runs.insert(runs.end(), m_levels[level].begin(), m_levels[level].end());
+
+    LogGated(LOG_VERBOSE, "Merging %llu sorted runs of call sites", (unsigned long long)runs.size());
+
+    return OpenReaders(runs);
+}
+
+bool ArcSpill::HasFailed() const
+{
+    return m_failed;
+}
+
+size_t ArcSpill::GetRunCount() const
+{
+    size_t count = 0;
+
+    for (size_t level = 0; level < m_levels.size(); level++)
+        count += m_levels[level].size();
+
+    return count;
+}
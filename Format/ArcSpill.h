@@ -0,0 +1,131 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_ARC_SPILL_H
+#define PIVO_GPROF_MODULE_ARC_SPILL_H
+
+#include <stdio.h>
+
+// call graph arc resolved to functions, with exact call site within caller
+struct callsite_arc
+{
+    // caller function index
+    uint32_t caller;
+    // call site offset from caller function start
+    uint32_t offset;
+    // callee function index
+    uint32_t callee;
+    // call count
+    uint64_t count;
+};
+
+// sorts call sites by caller, call site offset and callee
+struct CallSiteSortPredicate
+{
+    bool operator()(const callsite_arc &a, const callsite_arc &b) const
+    {
+        if (a.caller != b.caller)
+            return a.caller < b.caller;
+        if (a.offset != b.offset)
+            return a.offset < b.offset;
+        return a.callee < b.callee;
+    }
+};
+
+// count of runs of one level merged to single run of the next level; every call site is then rewritten
+// just once per level, and at most this count of runs per level is left for the final merge
+#define ARC_SPILL_MERGE_FANIN 16
+// minimum count of call sites read from run at once while merging
+#define ARC_SPILL_MIN_BLOCK 256
+
+// call sites collected in memory-bounded buffer, spilled to sorted runs in temporary files when it's full;
+// merged output is sorted by caller, offset and callee, and every call site is there just once
+class ArcSpill
+{
+    public:
+        ArcSpill();
+        ~ArcSpill();
+
+        // starts collecting; buffer holds at most bufferEntries call sites
+        void Begin(size_t bufferEntries);
+        // adds call site, spills buffer when it's full; returns false on I/O error
+        bool Add(const callsite_arc &site);
+        // finishes collecting and prepares merge of all runs; returns false on I/O error
+        bool StartMerge();
+        // retrieves next merged call site; returns false when there's none left (or on I/O error, see HasFailed)
+        bool Next(callsite_arc &site);
+        // did any I/O operation fail?
+        bool HasFailed() const;
+        // drops all runs and buffers
+        void Clear();
+
+        // count of runs written to temporary files
+        size_t GetRunCount() const;
+
+    private:
+        // sequential reader of single run
+        struct run_reader
+        {
+            FILE* file;
+            std::vector<callsite_arc> block;
+            // count of valid call sites in block, and position of current one
+            size_t count;
+            size_t pos;
+        };
+
+        // sorts buffer and merges duplicate call sites in it
+        static void SortBuffer(std::vector<callsite_arc> &buffer);
+        // writes buffer as new sorted run of the lowest level
+        bool SpillBuffer();
+        // does current call site of reader a follow the one of reader b? (min-heap ordering)
+        bool ReaderAfter(uint32_t a, uint32_t b) const;
+        // opens readers of supplied runs, sharing buffer capacity among their blocks
+        bool OpenReaders(const std::vector<FILE*> &runs);
+        // reads next block of run; returns false at its end
+        bool FillReader(run_reader &reader);
+        // retrieves next call site of k-way merge of all readers, not merging duplicates
+        bool NextMerged(callsite_arc &site);
+        // merges all runs of level to single run of the next level, cascading when that one gets full as well
+        bool MergeLevel(size_t level);
+        // closes all readers and their run files
+        void CloseReaders();
+
+        // call sites not spilled yet
+        std::vector<callsite_arc> m_buffer;
+        // buffer capacity
+        size_t m_bufferEntries;
+        // temporary files with sorted runs, by level; run of level n is a merge of ARC_SPILL_MERGE_FANIN runs of level n-1
+        std::vector<std::vector<FILE*>> m_levels;
+        // are call sites merged just from the buffer, as nothing was spilled?
+        bool m_bufferOnly;
+
+        // readers of runs being merged, and min-heap of their indexes ordered by current call site
+        std::vector<run_reader> m_readers;
+        std::vector<uint32_t> m_heap;
+        // position in buffer, when merging without any run
+        size_t m_bufferPos;
+        // merged call site waiting for its duplicates
+        callsite_arc m_pending;
+        bool m_hasPending;
+
+        bool m_failed;
+};
+
+#endif
@@ -0,0 +1,386 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "CallChains.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <algorithm>
+
+CallChainIndex::CallChainIndex()
+{
+    m_built = false;
+}
+
+void CallChainIndex::Clear()
+{
+    m_selfTime.clear();
+    m_component.clear();
+    m_componentTime.clear();
+    m_calleeOffsets.clear();
+    m_callees.clear();
+    m_callerOffsets.clear();
+    m_callers.clear();
+    m_slot.clear();
+    m_slotCount.clear();
+    m_entries.clear();
+    m_candidates.clear();
+    m_built = false;
+}
+
+bool CallChainIndex::IsBuilt() const
+{
+    return m_built;
+}
+
+uint32_t CallChainIndex::FindComponents(const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &callees)
+{
+    uint32_t count = (uint32_t)offsets.size() - 1;
+    uint32_t counter = 0, components = 0;
+
+    std::vector<uint32_t> index(count, CALL_CHAIN_NONE);
+    std::vector<uint32_t> low(count, 0);
+    std::vector<bool> onStack(count, false);
+    std::vector<uint32_t> stack;
+    // iterative Tarjan's algorithm: function and position in its callee list
+    std::vector<std::pair<uint32_t, uint32_t>> calls;
+
+    m_component.assign(count, 0);
+
+    for (uint32_t s = 0; s < count; s++)
+    {
+        if (index[s] != CALL_CHAIN_NONE)
+            continue;
+
+        index[s] = low[s] = counter++;
+        stack.push_back(s);
+        onStack[s] = true;
+        calls.push_back(std::make_pair(s, offsets[s]));
+
+        while (!calls.empty())
+        {
+            uint32_t v = calls.back().first;
+            uint32_t pos = calls.back().second;
+
+            if (pos < offsets[v + 1])
+            {
+                uint32_t w = callees[pos];
+                calls.back().second++;
+
+                if (index[w] == CALL_CHAIN_NONE)
+                {
+                    index[w] = low[w] = counter++;
+                    stack.push_back(w);
+                    onStack[w] = true;
+                    calls.push_back(std::make_pair(w, offsets[w]));
+                }
+                else if (onStack[w])
+                    low[v] = nmin(low[v], index[w]);
+
+                continue;
+            }
+
+            calls.pop_back();
+
+            // v is root of component - pop all its members; components are completed callees first
+            if (low[v] == index[v])
+            {
+                uint32_t w;
+                do
+                {
+                    w = stack.back();
+                    stack.pop_back();
+                    onStack[w] = false;
+                    m_component[w] = components;
+                } while (w != v);
+
+                components++;
+            }
+
+            if (!calls.empty())
+                low[calls.back().first] = nmin(low[calls.back().first], low[v]);
+        }
+    }
+
+    return components;
+}
+
+void CallChainIndex::Build(uint32_t functionCount, const std::vector<FlatProfileRecord> &flatProfile, const CallGraphMap &callGraph)
+{
+    LogGated(LOG_VERBOSE, "Building call chain index");
+
+    Clear();
+
+    uint32_t i;
+
+    m_selfTime.assign(functionCount, 0.0);
+    for (i = 0; i < flatProfile.size(); i++)
+    {
+        if (flatProfile[i].functionId < functionCount)
+            m_selfTime[flatProfile[i].functionId] = flatProfile[i].timeTotal;
+    }
+
+    // all arcs in compressed form, ordered by caller (call graph map is ordered by caller already)
+    std::vector<uint32_t> offsets(functionCount + 1, 0);
+    std::vector<uint32_t> callees;
+    std::vector<uint64_t> counts;
+
+    for (CallGraphMap::const_iterator itr = callGraph.begin(); itr != callGraph.end(); ++itr)
+    {
+        if (itr->first >= functionCount)
+            continue;
+
+        for (std::map<uint32_t, uint64_t>::const_iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
+        {
+            if (sitr->first >= functionCount)
+                continue;
+
+            offsets[itr->first + 1]++;
+            callees.push_back(sitr->first);
+            counts.push_back(sitr->second);
+        }
+    }
+
+    for (i = 0; i < functionCount; i++)
+        offsets[i + 1] += offsets[i];
+
+    uint32_t components = FindComponents(offsets, callees);
+
+    m_componentTime.assign(components, 0.0);
+    for (i = 0; i < functionCount; i++)
+        m_componentTime[m_component[i]] += m_selfTime[i];
+
+    // calls entering every component; arcs within component are not part of any chain
+    std::vector<uint64_t> callsIn(components, 0);
+    uint32_t u, cu, cv;
+    size_t a;
+
+    m_calleeOffsets.assign(components + 1, 0);
+    m_callerOffsets.assign(components + 1, 0);
+
+    for (u = 0; u < functionCount; u++)
+    {
+        for (a = offsets[u]; a < offsets[u + 1]; a++)
+        {
+            cu = m_component[u];
+            cv = m_component[callees[a]];
+            if (cu == cv)
+                continue;
+
+            callsIn[cv] += counts[a];
+            m_calleeOffsets[cu + 1]++;
+            m_callerOffsets[cv + 1]++;
+        }
+    }
+
+    for (i = 0; i < components; i++)
+    {
+        m_calleeOffsets[i + 1] += m_calleeOffsets[i];
+        m_callerOffsets[i + 1] += m_callerOffsets[i];
+    }
+
+    // place every arc to both lists
+    std::vector<uint32_t> calleeFill(m_calleeOffsets.begin(), m_calleeOffsets.end() - 1);
+    std::vector<uint32_t> callerFill(m_callerOffsets.begin(), m_callerOffsets.end() - 1);
+    m_callees.resize(m_calleeOffsets[components]);
+    m_callers.resize(m_callerOffsets[components]);
+
+    for (u = 0; u < functionCount; u++)
+    {
+        for (a = offsets[u]; a < offsets[u + 1]; a++)
+        {
+            cu = m_component[u];
+            cv = m_component[callees[a]];
+            if (cu == cv)
+                continue;
+
+            chain_arc arc = { u, callees[a], callsIn[cv] > 0 ? (double)counts[a] / (double)callsIn[cv] : 0.0 };
+            m_callees[calleeFill[cu]++] = arc;
+            m_callers[callerFill[cv]++] = arc;
+        }
+    }
+
+    m_slot.assign(components, CALL_CHAIN_NONE);
+    m_slotCount.assign(components, 0);
+    m_built = true;
+
+    LogGated(LOG_VERBOSE, "Call chain index contains %u components, %llu of %llu arcs", components,
+        (unsigned long long)m_callees.size(), (unsigned long long)callees.size());
+}
+
+void CallChainIndex::Query(uint32_t function, CallChainDirection direction, uint32_t count, std::vector<call_chain> &dst)
+{
+    dst.clear();
+
+    if (!m_built || function >= m_selfTime.size() || count == 0)
+        return;
+
+    // chains to function are searched backwards from it (towards callers), chains from function forwards
+    bool callers = (direction == CCD_CALLERS);
+    const std::vector<uint32_t> &walkOffsets = callers ? m_callerOffsets : m_calleeOffsets;
+    const std::vector<chain_arc> &walkArcs = callers ? m_callers : m_callees;
+    const std::vector<uint32_t> &dpOffsets = callers ? m_calleeOffsets : m_callerOffsets;
+    const std::vector<chain_arc> &dpArcs = callers ? m_callees : m_callers;
+
+    uint32_t start = m_component[function];
+
+    // collect components reachable in query direction
+    std::vector<uint32_t> reached;
+    reached.push_back(start);
+    m_slot[start] = 0;
+    m_slotCount[start] = 0;
+
+    for (size_t r = 0; r < reached.size(); r++)
+    {
+        uint32_t c = reached[r];
+        for (uint32_t a = walkOffsets[c]; a < walkOffsets[c + 1]; a++)
+        {
+            uint32_t w = m_component[callers ? walkArcs[a].caller : walkArcs[a].callee];
+            if (m_slot[w] == CALL_CHAIN_NONE)
+            {
+                m_slot[w] = 0;
+                m_slotCount[w] = 0;
+                reached.push_back(w);
+            }
+        }
+    }
+
+    // process every component after all its predecessors in query direction; callers have higher component IDs
+    if (callers)
+        std::sort(reached.begin(), reached.end());
+    else
+        std::sort(reached.begin(), reached.end(), std::greater<uint32_t>());
+
+    // min-heap on weight; its top is the lightest of kept entries
+    auto heavier = [](const chain_entry &a, const chain_entry &b) {
+        return a.weight > b.weight;
+    };
+
+    // adds entry to bounded heap of candidates; returns false, if the entry is too light
+    auto offer = [this, count, &heavier](const chain_entry &entry) -> bool {
+        if (m_candidates.size() < count)
+        {
+            m_candidates.push_back(entry);
+            std::push_heap(m_candidates.begin(), m_candidates.end(), heavier);
+            return true;
+        }
+
+        if (entry.weight <= m_candidates.front().weight)
+            return false;
+
+        std::pop_heap(m_candidates.begin(), m_candidates.end(), heavier);
+        m_candidates.back() = entry;
+        std::push_heap(m_candidates.begin(), m_candidates.end(), heavier);
+        return true;
+    };
+
+    m_entries.clear();
+    m_entries.push_back({ 1.0, CALL_CHAIN_NONE, CALL_CHAIN_NONE });
+    m_slotCount[start] = 1;
+
+    for (size_t r = 1; r < reached.size(); r++)
+    {
+        uint32_t c = reached[r];
+
+        m_candidates.clear();
+
+        // keep count heaviest partial chains of this component
+        for (uint32_t a = dpOffsets[c]; a < dpOffsets[c + 1]; a++)
+        {
+            uint32_t p = m_component[callers ? dpArcs[a].callee : dpArcs[a].caller];
+
+            // predecessor is not on any chain of this query
+            if (m_slot[p] == CALL_CHAIN_NONE)
+                continue;
+
+            // entries of predecessor are sorted from the heaviest, so the scan stops at the first one not making it
+            for (uint32_t e = m_slot[p]; e < m_slot[p] + m_slotCount[p]; e++)
+            {
+                if (!offer({ m_entries[e].weight * dpArcs[a].share, a, e }))
+                    break;
+            }
+        }
+
+        // sorting the heap with inverted predicate leaves the heaviest entry first
+        std::sort_heap(m_candidates.begin(), m_candidates.end(), heavier);
+
+        m_slot[c] = (uint32_t)m_entries.size();
+        m_slotCount[c] = (uint32_t)m_candidates.size();
+        m_entries.insert(m_entries.end(), m_candidates.begin(), m_candidates.end());
+    }
+
+    // complete chains: callers query ends in components without callers, callees query in any reached component;
+    // chain weight is converted to time of the queried function, or time of the last component, respectively
+    m_candidates.clear();
+    for (size_t r = 0; r < reached.size(); r++)
+    {
+        uint32_t c = reached[r];
+        if (callers && walkOffsets[c] != walkOffsets[c + 1])
+            continue;
+
+        double self = callers ? m_selfTime[function] : m_componentTime[c];
+        if (self <= 0.0)
+            continue;
+
+        for (uint32_t e = m_slot[c]; e < m_slot[c] + m_slotCount[c]; e++)
+        {
+            if (!offer({ m_entries[e].weight * self, CALL_CHAIN_NONE, e }))
+                break;
+        }
+    }
+
+    std::sort_heap(m_candidates.begin(), m_candidates.end(), heavier);
+
+    std::vector<uint32_t> arcs;
+
+    dst.resize(m_candidates.size());
+    for (size_t i = 0; i < m_candidates.size(); i++)
+    {
+        call_chain &chain = dst[i];
+        chain.timeTotal = m_candidates[i].weight;
+
+        // arcs along the chain; callers chain is walked from its start, callees chain from its end
+        arcs.clear();
+        for (uint32_t e = m_candidates[i].prevEntry; m_entries[e].arc != CALL_CHAIN_NONE; e = m_entries[e].prevEntry)
+            arcs.push_back(m_entries[e].arc);
+        if (!callers)
+            std::reverse(arcs.begin(), arcs.end());
+
+        // functions entering and leaving every component; they differ only within recursion
+        if (!callers || arcs.empty())
+            chain.functions.push_back(function);
+
+        for (size_t a = 0; a < arcs.size(); a++)
+        {
+            const chain_arc &arc = dpArcs[arcs[a]];
+            if (chain.functions.empty() || chain.functions.back() != arc.caller)
+                chain.functions.push_back(arc.caller);
+            chain.functions.push_back(arc.callee);
+        }
+
+        if (callers && chain.functions.back() != function)
+            chain.functions.push_back(function);
+    }
+
+    for (size_t r = 0; r < reached.size(); r++)
+        m_slot[reached[r]] = CALL_CHAIN_NONE;
+}
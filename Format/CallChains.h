@@ -0,0 +1,114 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_CALL_CHAINS_H
+#define PIVO_GPROF_MODULE_CALL_CHAINS_H
+
+#include "FlatProfileStructs.h"
+#include "CallGraphStructs.h"
+
+// no function / no chain predecessor
+#define CALL_CHAIN_NONE ((uint32_t)-1)
+
+// direction of call chain query
+enum CallChainDirection
+{
+    CCD_CALLERS = 0,    // chains from program roots to given function
+    CCD_CALLEES = 1     // chains from given function to its (transitive) callees
+};
+
+// single call chain
+struct call_chain
+{
+    // time of the last function in chain attributed to this chain
+    double timeTotal;
+    // function IDs, from the outermost caller to the innermost callee
+    std::vector<uint32_t> functions;
+};
+
+// index of condensed call graph answering heaviest call chain queries
+//
+// Recursive functions (strongly connected components of call graph) are collapsed to single nodes, so all
+// chains are acyclic. Time of a component is split among arcs entering it proportionally to call counts,
+// the same way gprof propagates time through cycles; weight of a chain is the self time of its end multiplied
+// by shares of all arcs along the chain.
+class CallChainIndex
+{
+    public:
+        CallChainIndex();
+
+        // builds index; flat profile has to be sorted by function ID
+        void Build(uint32_t functionCount, const std::vector<FlatProfileRecord> &flatProfile, const CallGraphMap &callGraph);
+        // drops built index
+        void Clear();
+        // was the index built?
+        bool IsBuilt() const;
+
+        // retrieves at most count heaviest chains leading to (or from) given function, the heaviest first
+        void Query(uint32_t function, CallChainDirection direction, uint32_t count, std::vector<call_chain> &dst);
+
+    private:
+        // arc between components
+        struct chain_arc
+        {
+            // caller and callee function
+            uint32_t caller;
+            uint32_t callee;
+            // share of callee component time attributed to this arc
+            double share;
+        };
+
+        // partial chain kept in component's bounded heap
+        struct chain_entry
+        {
+            // product of arc shares along the chain
+            double weight;
+            // arc leading to predecessor component (CALL_CHAIN_NONE for chain start)
+            uint32_t arc;
+            // entry of predecessor component
+            uint32_t prevEntry;
+        };
+
+        // finds strongly connected components of call graph given by caller offsets to callee list
+        uint32_t FindComponents(const std::vector<uint32_t> &offsets, const std::vector<uint32_t> &callees);
+
+        // self time of every function
+        std::vector<double> m_selfTime;
+        // strongly connected component of every function; callees have lower IDs than their callers
+        std::vector<uint32_t> m_component;
+        // self time of every component
+        std::vector<double> m_componentTime;
+
+        // arcs between components, by caller component and by callee component
+        std::vector<uint32_t> m_calleeOffsets;
+        std::vector<chain_arc> m_callees;
+        std::vector<uint32_t> m_callerOffsets;
+        std::vector<chain_arc> m_callers;
+
+        // query scratch: first entry and entry count of every reached component, entries of all reached components
+        std::vector<uint32_t> m_slot;
+        std::vector<uint32_t> m_slotCount;
+        std::vector<chain_entry> m_entries;
+        std::vector<chain_entry> m_candidates;
+
+        bool m_built;
+};
+
+#endif
@@ -0,0 +1,262 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "CallSiteTable.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <algorithm>
+#include <unistd.h>
+
+CallSiteTable::CallSiteTable()
+{
+    m_file = nullptr;
+    m_spilledCount = 0;
+}
+
+CallSiteTable::~CallSiteTable()
+{
+    Clear();
+}
+
+void CallSiteTable::Clear()
+{
+    // temporary file is deleted once closed
+    if (m_file)
+        fclose(m_file);
+    m_file = nullptr;
+    m_spilledCount = 0;
+
+    m_sites.clear();
+    m_byCallee.clear();
+    m_pending.clear();
+}
+
+void CallSiteTable::Add(const callsite_arc &site)
+{
+    m_sites.push_back(site);
+}
+
+void CallSiteTable::Build()
+{
+    size_t i, last;
+
+    // sort call sites by caller, offset and callee, so we could merge duplicates and search by caller
+    std::sort(m_sites.begin(), m_sites.end(), CallSiteSortPredicate());
+
+    // merge duplicate entries (i.e. from multiple merged gmon files)
+    last = 0;
+    for (i = 1; i < m_sites.size(); i++)
+    {
+        if (m_sites[i].caller == m_sites[last].caller && m_sites[i].offset == m_sites[last].offset
+            && m_sites[i].callee == m_sites[last].callee)
+        {
+            m_sites[last].count += m_sites[i].count;
+        }
+        else
+            m_sites[++last] = m_sites[i];
+    }
+
+    if (!m_sites.empty())
+        m_sites.resize(last + 1);
+
+    // build secondary index ordered by callee, to be able to search by callee as well
+    m_byCallee.resize(m_sites.size());
+    for (i = 0; i < m_sites.size(); i++)
+        m_byCallee[i] = (uint32_t)i;
+
+    std::stable_sort(m_byCallee.begin(), m_byCallee.end(), [this](uint32_t a, uint32_t b) {
+        return m_sites[a].callee < m_sites[b].callee;
+    });
+
+    LogGated(LOG_VERBOSE, "Call site table contains %llu call sites", (unsigned long long)m_sites.size());
+}
+
+bool CallSiteTable::BeginSpilled()
+{
+    Clear();
+
+    m_file = tmpfile();
+    if (!m_file)
+    {
+        LogFunc(LOG_ERROR, "Could not create temporary file for call site table");
+        return false;
+    }
+
+    m_pending.reserve(CALL_SITE_TABLE_BLOCK);
+
+    return true;
+}
+
+bool CallSiteTable::FlushSpilled()
+{
+    if (m_pending.empty())
+        return true;
+
+    if (fwrite(&m_pending[0], sizeof(callsite_arc), m_pending.size(), m_file) != m_pending.size())
+    {
+        LogFunc(LOG_ERROR, "Could not write call site table to temporary file");
+        return false;
+    }
+
+    m_spilledCount += m_pending.size();
+    m_pending.clear();
+
+    return true;
+}
+
+bool CallSiteTable::AppendSpilled(const callsite_arc &site)
+{
+    m_pending.push_back(site);
+
+    if (m_pending.size() >= CALL_SITE_TABLE_BLOCK)
+        return FlushSpilled();
+
+    return true;
+}
+
+bool CallSiteTable::FinishSpilled()
+{
+    // table is read using pread, bypassing stdio buffers
+    if (!FlushSpilled() || fflush(m_file) != 0)
+        return false;
+
+    std::vector<callsite_arc>().swap(m_pending);
+
+    LogGated(LOG_VERBOSE, "Call site table contains %llu call sites, kept in temporary file", (unsigned long long)m_spilledCount);
+
+    return true;
+}
+
+uint64_t CallSiteTable::GetCount() const
+{
+    return m_file ? m_spilledCount : m_sites.size();
+}
+
+size_t CallSiteTable::ReadSpilled(uint64_t first, size_t count, callsite_arc* dst) const
+{
+    size_t length = count * sizeof(callsite_arc);
+    ssize_t got = pread(fileno(m_file), dst, length, (off_t)(first * sizeof(callsite_arc)));
+
+    if (got < 0)
+    {
+        LogFunc(LOG_ERROR, "Could not read call site table from temporary file");
+        return 0;
+    }
+
+    return (size_t)got / sizeof(callsite_arc);
+}
+
+size_t CallSiteTable::Read(uint64_t first, size_t count, std::vector<callsite_arc> &dst) const
+{
+    uint64_t total = GetCount();
+
+    if (first >= total)
+    {
+        dst.clear();
+        return 0;
+    }
+
+    count = (size_t)nmin((uint64_t)count, total - first);
+    dst.resize(count);
+
+    if (m_file)
+        count = ReadSpilled(first, count, &dst[0]);
+    else
+        std::copy(m_sites.begin() + first, m_sites.begin() + first + count, dst.begin());
+
+    dst.resize(count);
+
+    return count;
+}
+
+void CallSiteTable::GetByCaller(uint32_t caller, std::vector<callsite_arc> &dst) const
+{
+    dst.clear();
+
+    callsite_arc key = { caller, 0, 0, 0 };
+
+    if (!m_file)
+    {
+        // table is sorted by caller first, so the call sites of one caller form continuous block
+        std::vector<callsite_arc>::const_iterator itr = std::lower_bound(m_sites.begin(), m_sites.end(), key, CallSiteSortPredicate());
+        for (; itr != m_sites.end() && itr->caller == caller; ++itr)
+            dst.push_back(*itr);
+        return;
+    }
+
+    // binary search for the first call site of caller within the file
+    uint64_t low = 0, high = m_spilledCount;
+    callsite_arc site;
+    while (low < high)
+    {
+        uint64_t mid = low + (high - low) / 2;
+        if (ReadSpilled(mid, 1, &site) != 1)
+            return;
+
+        if (site.caller < caller)
+            low = mid + 1;
+        else
+            high = mid;
+    }
+
+    std::vector<callsite_arc> block;
+    for (uint64_t pos = low; Read(pos, CALL_SITE_TABLE_BLOCK, block) > 0; pos += block.size())
+    {
+        for (size_t i = 0; i < block.size(); i++)
+        {
+            if (block[i].caller != caller)
+                return;
+
+            dst.push_back(block[i]);
+        }
+    }
+}
+
+void CallSiteTable::GetByCallee(uint32_t callee, std::vector<callsite_arc> &dst) const
+{
+    dst.clear();
+
+    if (!m_file)
+    {
+        std::vector<uint32_t>::const_iterator itr = std::lower_bound(m_byCallee.begin(), m_byCallee.end(), callee,
+            [this](uint32_t index, uint32_t value) {
+                return m_sites[index].callee < value;
+            });
+
+        for (; itr != m_byCallee.end() && m_sites[*itr].callee == callee; ++itr)
+            dst.push_back(m_sites[*itr]);
+        return;
+    }
+
+    // spilled table has no callee index, as it would grow with the count of call sites
+    std::vector<callsite_arc> block;
+    for (uint64_t pos = 0; Read(pos, CALL_SITE_TABLE_BLOCK, block) > 0; pos += block.size())
+    {
+        for (size_t i = 0; i < block.size(); i++)
+        {
+            if (block[i].callee == callee)
+                dst.push_back(block[i]);
+        }
+    }
+}
@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#ifndef PIVO_GPROF_MODULE_CALL_SITE_TABLE_H
+#define PIVO_GPROF_MODULE_CALL_SITE_TABLE_H
+
+#include "ArcSpill.h"
+
+// count of call sites read from (or written to) spilled table at once
+#define CALL_SITE_TABLE_BLOCK 4096
+
+// table of call sites sorted by caller, offset and callee, searchable by caller and callee; kept either in memory
+// with callee index, or (when loading within memory budget) in temporary file, searched by caller using binary
+// search and by callee using sequential scan
+class CallSiteTable
+{
+    public:
+        CallSiteTable();
+        ~CallSiteTable();
+
+        // drops all call sites; in-memory storage is kept for next load
+        void Clear();
+
+        // adds call site to in-memory table; Build has to be called once all call sites are added
+        void Add(const callsite_arc &site);
+        // sorts in-memory table, merges duplicate call sites and builds callee index
+        void Build();
+
+        // starts table kept in temporary file; returns false on I/O error
+        bool BeginSpilled();
+        // appends call site to spilled table; call sites have to come sorted and merged already
+        bool AppendSpilled(const callsite_arc &site);
+        // finishes spilled table, so it could be searched
+        bool FinishSpilled();
+
+        // retrieves count of call sites
+        uint64_t GetCount() const;
+        // reads at most count call sites starting at index first; returns count of call sites read
+        size_t Read(uint64_t first, size_t count, std::vector<callsite_arc> &dst) const;
+        // retrieves all call sites within given caller function, ordered by offset
+        void GetByCaller(uint32_t caller, std::vector<callsite_arc> &dst) const;
+        // retrieves all call sites calling given callee function, ordered by caller
+        void GetByCallee(uint32_t callee, std::vector<callsite_arc> &dst) const;
+
+    private:
+        // writes pending call sites to spilled table
+        bool FlushSpilled();
+        // reads call sites from spilled table
+        size_t ReadSpilled(uint64_t first, size_t count, callsite_arc* dst) const;
+
+        // in-memory table and its index ordered by callee
+        std::vector<callsite_arc> m_sites;
+        std::vector<uint32_t> m_byCallee;
+
+        // temporary file with spilled table, null when the table is in memory
+        FILE* m_file;
+        // count of call sites in spilled table
+        uint64_t m_spilledCount;
+        // call sites waiting to be written to spilled table
+        std::vector<callsite_arc> m_pending;
+};
+
+#endif
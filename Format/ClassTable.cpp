@@ -0,0 +1,206 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "ClassTable.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <string.h>
+
+ClassTable::ClassTable()
+{
+    //
+}
+
+void ClassTable::Clear()
+{
+    m_classes.clear();
+    m_classIndex.clear();
+}
+
+static inline bool IsIdentifierChar(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+bool ClassTable::FindScope(const char* name, size_t length, size_t &scopeStart, size_t &scopeLength)
+{
+    // nesting depth of template arguments, parentheses, braces (lambdas) and brackets (ABI tags)
+    int angle = 0, paren = 0, brace = 0, bracket = 0;
+    size_t start = 0;
+    size_t lastSeparator = 0;
+    bool found = false;
+
+    for (size_t i = 0; i < length; i++)
+    {
+        char c = name[i];
+        bool top = (angle == 0 && paren == 0 && brace == 0 && bracket == 0);
+
+        if (top)
+        {
+            // operator names contain characters, that would break nesting (operator<, operator() etc.); scope ends before them
+            if (c == 'o' && length - i >= 8 && strncmp(name + i, "operator", 8) == 0
+                && (i == 0 || name[i - 1] == ':' || name[i - 1] == ' ')
+                && (i + 8 == length || !IsIdentifierChar(name[i + 8])))
+                break;
+
+            if (c == ':' && i + 1 < length && name[i + 1] == ':')
+            {
+                lastSeparator = i;
+                found = true;
+                i++;
+                continue;
+            }
+
+            // space on top level separates return type of template functions, or prefixes like "non-virtual thunk to"
+            if (c == ' ')
+            {
+                start = i + 1;
+                found = false;
+                continue;
+            }
+        }
+
+        switch (c)
+        {
+            case '<':
+                angle++;
+                break;
+            case '>':
+                if (angle > 0)
+                    angle--;
+                break;
+            case '(':
+                paren++;
+                break;
+            case ')':
+                if (paren > 0)
+                    paren--;
+                // parameter list ends the name, unless it's followed by local entity scope (or it was "(anonymous namespace)")
+                if (paren == 0 && angle == 0 && brace == 0 && bracket == 0 && !(i + 2 < length && name[i + 1] == ':' && name[i + 2] == ':'))
+                    i = length;
+                break;
+            case '{':
+                brace++;
+                break;
+            case '}':
+                if (brace > 0)
+                    brace--;
+                break;
+            case '[':
+                bracket++;
+                break;
+            case ']':
+                if (bracket > 0)
+                    bracket--;
+                break;
+        }
+    }
+
+    if (!found || lastSeparator <= start)
+        return false;
+
+    scopeStart = start;
+    scopeLength = lastSeparator - start;
+
+    return true;
+}
+
+uint32_t ClassTable::Intern(const char* scope, size_t length)
+{
+    m_key.assign(scope, length);
+
+    std::unordered_map<std::string, uint32_t>::iterator itr = m_classIndex.find(m_key);
+    if (itr != m_classIndex.end())
+        return itr->second;
+
+    uint32_t classId = (uint32_t)m_classes.size();
+
+    m_classIndex[m_key] = classId;
+    m_classes.push_back({ m_key });
+
+    return classId;
+}
+
+void ClassTable::Assign(std::vector<FunctionEntry> &functions)
+{
+    LogGated(LOG_VERBOSE, "Building class table from function names");
+
+    Clear();
+
+    size_t scopeStart, scopeLength;
+
+    for (uint32_t i = 0; i < functions.size(); i++)
+    {
+        FunctionEntry &fe = functions[i];
+
+        if (!FindScope(fe.name.c_str(), fe.name.length(), scopeStart, scopeLength))
+        {
+            fe.classId = NO_CLASS;
+            continue;
+        }
+
+        fe.classId = Intern(fe.name.c_str() + scopeStart, scopeLength);
+    }
+
+    // the table does not change from now on, the index is not needed anymore
+    m_classIndex.clear();
+
+    LogGated(LOG_VERBOSE, "Class table contains %llu classes", (unsigned long long)m_classes.size());
+}
+
+void ClassTable::BuildProfile(const std::vector<FunctionEntry> &functions, const std::vector<FlatProfileRecord> &flatProfile,
+    std::vector<class_profile_record> &dst) const
+{
+    dst.resize(m_classes.size());
+    for (uint32_t c = 0; c < m_classes.size(); c++)
+        dst[c] = { c, 0, 0, 0.0 };
+
+    size_t fp = 0;
+
+    // single pass over function table; sorted flat profile is walked alongside
+    for (uint32_t i = 0; i < functions.size(); i++)
+    {
+        const FunctionEntry &fe = functions[i];
+
+        if (fe.classId == NO_CLASS)
+            continue;
+
+        class_profile_record &cp = dst[fe.classId];
+        cp.functionCount++;
+
+        while (fp < flatProfile.size() && flatProfile[fp].functionId < i)
+            fp++;
+
+        if (fp < flatProfile.size() && flatProfile[fp].functionId == i)
+        {
+            cp.callCount += flatProfile[fp].callCount;
+            cp.timeTotal += flatProfile[fp].timeTotal;
+        }
+    }
+}
+
+const std::vector<ClassEntry>& ClassTable::GetClasses() const
+{
+    return m_classes;
+}
+
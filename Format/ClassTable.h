@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_CLASS_TABLE_H
+#define PIVO_GPROF_MODULE_CLASS_TABLE_H
+
+#include "UnitIdentifiers.h"
+#include "FlatProfileStructs.h"
+
+#include <unordered_map>
+
+// aggregated profile of single class (or namespace)
+struct class_profile_record
+{
+    // class ID (index to class table)
+    uint32_t classId;
+    // number of functions within class
+    uint32_t functionCount;
+    // total call count of class functions
+    uint64_t callCount;
+    // total self time of class functions
+    double timeTotal;
+};
+
+// class table built from scopes of demangled function names
+class ClassTable
+{
+    public:
+        ClassTable();
+
+        // builds class table and assigns class IDs to functions
+        void Assign(std::vector<FunctionEntry> &functions);
+        // aggregates flat profile of functions with assigned classes; flat profile has to be sorted by function ID
+        void BuildProfile(const std::vector<FunctionEntry> &functions, const std::vector<FlatProfileRecord> &flatProfile,
+            std::vector<class_profile_record> &dst) const;
+        // drops built table
+        void Clear();
+
+        // retrieves class table
+        const std::vector<ClassEntry>& GetClasses() const;
+
+        // finds enclosing scope of demangled function name (without the trailing "::"); returns false if there's none
+        static bool FindScope(const char* name, size_t length, size_t &scopeStart, size_t &scopeLength);
+
+    private:
+        // retrieves ID of scope, creates new class when needed
+        uint32_t Intern(const char* scope, size_t length);
+
+        // class entries, indexed by class ID
+        std::vector<ClassEntry> m_classes;
+        // scope name to class ID map, used only while assigning
+        std::unordered_map<std::string, uint32_t> m_classIndex;
+        // lookup key buffer, reused to avoid allocations
+        std::string m_key;
+};
+
+#endif
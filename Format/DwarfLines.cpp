@@ -0,0 +1,763 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "DwarfLines.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// ELF identification and section header constants we need
+#define ELF_MAGIC "\x7f" "ELF"
+#define ELF_CLASS32 1
+#define ELF_CLASS64 2
+#define ELF_DATA_LSB 1
+#define ELF_SHF_COMPRESSED 0x800
+
+// line program opcodes
+enum DwarfLineOpcode
+{
+    DW_LNS_copy = 1,
+    DW_LNS_advance_pc = 2,
+    DW_LNS_advance_line = 3,
+    DW_LNS_set_file = 4,
+    DW_LNS_set_column = 5,
+    DW_LNS_negate_stmt = 6,
+    DW_LNS_set_basic_block = 7,
+    DW_LNS_const_add_pc = 8,
+    DW_LNS_fixed_advance_pc = 9,
+
+    DW_LNE_end_sequence = 1,
+    DW_LNE_set_address = 2,
+    DW_LNE_define_file = 3
+};
+
+// DWARF 5 line header entry content types and forms
+enum DwarfLineForm
+{
+    DW_LNCT_path = 1,
+    DW_LNCT_directory_index = 2,
+
+    DW_FORM_block2 = 0x03,
+    DW_FORM_block4 = 0x04,
+    DW_FORM_data2 = 0x05,
+    DW_FORM_data4 = 0x06,
+    DW_FORM_data8 = 0x07,
+    DW_FORM_string = 0x08,
+    DW_FORM_block = 0x09,
+    DW_FORM_block1 = 0x0a,
+    DW_FORM_data1 = 0x0b,
+    DW_FORM_strp = 0x0e,
+    DW_FORM_udata = 0x0f,
+    DW_FORM_data16 = 0x1e,
+    DW_FORM_line_strp = 0x1f
+};
+
+// bounds-checked little endian readers
+
+static bool ReadU(const uint8_t* &ptr, const uint8_t* end, size_t size, uint64_t &value)
+{
+    if ((size_t)(end - ptr) < size)
+        return false;
+
+    value = 0;
+    for (size_t i = 0; i < size; i++)
+        value |= ((uint64_t)ptr[i]) << (8 * i);
+
+    ptr += size;
+    return true;
+}
+
+static bool ReadULEB(const uint8_t* &ptr, const uint8_t* end, uint64_t &value)
+{
+    uint32_t shift = 0;
+    value = 0;
+
+    while (ptr < end)
+    {
+        uint8_t b = *ptr++;
+        if (shift < 64)
+            value |= ((uint64_t)(b & 0x7f)) << shift;
+        shift += 7;
+
+        if ((b & 0x80) == 0)
+            return true;
+    }
+
+    return false;
+}
+
+static bool ReadSLEB(const uint8_t* &ptr, const uint8_t* end, int64_t &value)
+{
+    uint32_t shift = 0;
+    uint8_t b = 0;
+    value = 0;
+
+    while (ptr < end)
+    {
+        b = *ptr++;
+        if (shift < 64)
+            value |= ((int64_t)(b & 0x7f)) << shift;
+        shift += 7;
+
+        if ((b & 0x80) == 0)
+        {
+            // sign extension
+            if (shift < 64 && (b & 0x40))
+                value |= -((int64_t)1 << shift);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool ReadCString(const uint8_t* &ptr, const uint8_t* end, const char* &str)
+{
+    const uint8_t* zero = (const uint8_t*)memchr(ptr, 0, end - ptr);
+    if (!zero)
+        return false;
+
+    str = (const char*)ptr;
+    ptr = zero + 1;
+    return true;
+}
+
+// orders rows by address; end of sequence goes first, so the following sequence row wins
+struct LineRowSortPredicate
+{
+    bool operator()(const line_row &a, const line_row &b) const
+    {
+        if (a.address != b.address)
+            return a.address < b.address;
+        return (a.line == DWARF_LINE_END_SEQUENCE) && (b.line != DWARF_LINE_END_SEQUENCE);
+    }
+};
+
+DwarfLineTable::DwarfLineTable()
+{
+    m_lineStr = nullptr;
+    m_lineStrSize = 0;
+    m_str = nullptr;
+    m_strSize = 0;
+    m_addressSize = 8;
+}
+
+void DwarfLineTable::Clear()
+{
+    m_rows.clear();
+    m_files.clear();
+    m_fileIndex.clear();
+}
+
+bool DwarfLineTable::Load(const char* binaryFilename)
+{
+    Clear();
+
+    LogGated(LOG_VERBOSE, "Reading line table from %s", binaryFilename);
+
+    int fd = open(binaryFilename, O_RDONLY);
+    if (fd < 0)
+    {
+        LogFunc(LOG_ERROR, "Could not open binary file %s", binaryFilename);
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (map == MAP_FAILED)
+    {
+        LogFunc(LOG_ERROR, "Could not map binary file %s to memory", binaryFilename);
+        return false;
+    }
+
+    bool result = ParseElf((const uint8_t*)map, (size_t)st.st_size);
+
+    munmap(map, (size_t)st.st_size);
+
+    m_lineStr = nullptr;
+    m_str = nullptr;
+
+    if (!result)
+    {
+        Clear();
+        return false;
+    }
+
+    // sort rows from all sequences by address, and remove duplicates (the last row at given address wins)
+    std::stable_sort(m_rows.begin(), m_rows.end(), LineRowSortPredicate());
+
+    size_t last = 0;
+    for (size_t i = 1; i < m_rows.size(); i++)
+    {
+        if (m_rows[i].address == m_rows[last].address)
+            m_rows[last] = m_rows[i];
+        else
+            m_rows[++last] = m_rows[i];
+    }
+
+    if (!m_rows.empty())
+        m_rows.resize(last + 1);
+
+    LogGated(LOG_VERBOSE, "Line table contains %llu rows in %llu files", (unsigned long long)m_rows.size(), (unsigned long long)m_files.size());
+
+    return true;
+}
+
+bool DwarfLineTable::ParseElf(const uint8_t* data, size_t size)
+{
+    const uint8_t* end = data + size;
+
+    if (size < 64 || memcmp(data, ELF_MAGIC, 4) != 0)
+    {
+        LogFunc(LOG_ERROR, "Binary file is not ELF file, line table not available");
+        return false;
+    }
+
+    if (data[5] != ELF_DATA_LSB)
+    {
+        LogFunc(LOG_ERROR, "Only little endian ELF binaries are supported for line tables");
+        return false;
+    }
+
+    bool elf64 = (data[4] == ELF_CLASS64);
+    if (!elf64 && data[4] != ELF_CLASS32)
+        return false;
+
+    m_addressSize = elf64 ? 8 : 4;
+
+    uint64_t shoff, shentsize, shnum, shstrndx;
+    const uint8_t* ptr;
+
+    // read section header table location from ELF header
+    if (elf64)
+    {
+        ptr = data + 0x28;
+        ReadU(ptr, end, 8, shoff);
+        ptr = data + 0x3A;
+    }
+    else
+    {
+        ptr = data + 0x20;
+        ReadU(ptr, end, 4, shoff);
+        ptr = data + 0x2E;
+    }
+
+    ReadU(ptr, end, 2, shentsize);
+    ReadU(ptr, end, 2, shnum);
+    ReadU(ptr, end, 2, shstrndx);
+
+    if (shnum == 0 || shstrndx >= shnum || shoff > size || shentsize * shnum > size - shoff)
+    {
+        LogFunc(LOG_ERROR, "Binary file contains invalid section header table");
+        return false;
+    }
+
+    // section header fields: name, flags, offset, size
+    struct SectionInfo
+    {
+        uint64_t name;
+        uint64_t flags;
+        uint64_t offset;
+        uint64_t size;
+    };
+
+    std::vector<SectionInfo> sections(shnum);
+    for (uint64_t i = 0; i < shnum; i++)
+    {
+        const uint8_t* sh = data + shoff + i * shentsize;
+        uint64_t dummy;
+
+        ptr = sh;
+        ReadU(ptr, end, 4, sections[i].name);
+        ReadU(ptr, end, 4, dummy);
+        ReadU(ptr, end, elf64 ? 8 : 4, sections[i].flags);
+        ReadU(ptr, end, elf64 ? 8 : 4, dummy);
+        ReadU(ptr, end, elf64 ? 8 : 4, sections[i].offset);
+        ReadU(ptr, end, elf64 ? 8 : 4, sections[i].size);
+
+        if (sections[i].offset > size || sections[i].size > size - sections[i].offset)
+            sections[i].size = 0;
+    }
+
+    const SectionInfo &strtab = sections[shstrndx];
+    const SectionInfo* debugLine = nullptr;
+
+    for (uint64_t i = 0; i < shnum; i++)
+    {
+        if (sections[i].name >= strtab.size)
+            continue;
+
+        const char* name = (const char*)data + strtab.offset + sections[i].name;
+        size_t maxlen = strtab.size - sections[i].name;
+
+        if (strncmp(name, ".debug_line", maxlen) == 0)
+            debugLine = &sections[i];
+        else if (strncmp(name, ".debug_line_str", maxlen) == 0)
+        {
+            m_lineStr = data + sections[i].offset;
+            m_lineStrSize = sections[i].size;
+        }
+        else if (strncmp(name, ".debug_str", maxlen) == 0)
+        {
+            m_str = data + sections[i].offset;
+            m_strSize = sections[i].size;
+        }
+    }
+
+    if (!debugLine || debugLine->size == 0)
+    {
+        LogFunc(LOG_ERROR, "Binary file does not contain .debug_line section, line table not available");
+        return false;
+    }
+
+    if (debugLine->flags & ELF_SHF_COMPRESSED)
+    {
+        LogFunc(LOG_ERROR, "Compressed debug sections are not supported, line table not available");
+        return false;
+    }
+
+    ptr = data + debugLine->offset;
+    const uint8_t* sectionEnd = ptr + debugLine->size;
+
+    // go through all line program units
+    while (ptr < sectionEnd)
+    {
+        if (!ParseUnit(ptr, sectionEnd))
+        {
+            LogGated(LOG_WARNING, "Malformed line program unit found, the rest of line table ignored");
+            break;
+        }
+    }
+
+    return true;
+}
+
+uint32_t DwarfLineTable::InternFile(const std::string &path)
+{
+    std::unordered_map<std::string, uint32_t>::iterator itr = m_fileIndex.find(path);
+    if (itr != m_fileIndex.end())
+        return itr->second;
+
+    uint32_t index = (uint32_t)m_files.size();
+    m_files.push_back(path);
+    m_fileIndex[path] = index;
+
+    return index;
+}
+
+bool DwarfLineTable::ReadForm(const uint8_t* &ptr, const uint8_t* end, uint64_t form, bool is64, std::string* str, uint64_t* value)
+{
+    uint64_t v = 0, len;
+    const char* s;
+
+    switch (form)
+    {
+        case DW_FORM_string:
+            if (!ReadCString(ptr, end, s))
+                return false;
+            if (str)
+                *str = s;
+            return true;
+        case DW_FORM_line_strp:
+        case DW_FORM_strp:
+        {
+            if (!ReadU(ptr, end, is64 ? 8 : 4, v))
+                return false;
+
+            const uint8_t* base = (form == DW_FORM_line_strp) ? m_lineStr : m_str;
+            size_t baseSize = (form == DW_FORM_line_strp) ? m_lineStrSize : m_strSize;
+
+            if (str)
+            {
+                if (!base || v >= baseSize)
+                    return false;
+                *str = std::string((const char*)base + v, strnlen((const char*)base + v, baseSize - v));
+            }
+            return true;
+        }
+        case DW_FORM_udata:
+            if (!ReadULEB(ptr, end, v))
+                return false;
+            break;
+        case DW_FORM_data1:
+            if (!ReadU(ptr, end, 1, v))
+                return false;
+            break;
+        case DW_FORM_data2:
+            if (!ReadU(ptr, end, 2, v))
+                return false;
+            break;
+        case DW_FORM_data4:
+            if (!ReadU(ptr, end, 4, v))
+                return false;
+            break;
+        case DW_FORM_data8:
+            if (!ReadU(ptr, end, 8, v))
+                return false;
+            break;
+        case DW_FORM_data16:
+            if (end - ptr < 16)
+                return false;
+            ptr += 16;
+            break;
+        case DW_FORM_block:
+        case DW_FORM_block1:
+        case DW_FORM_block2:
+        case DW_FORM_block4:
+            if (form == DW_FORM_block)
+            {
+                if (!ReadULEB(ptr, end, len))
+                    return false;
+            }
+            else if (!ReadU(ptr, end, form == DW_FORM_block1 ? 1 : (form == DW_FORM_block2 ? 2 : 4), len))
+                return false;
+
+            if ((uint64_t)(end - ptr) < len)
+                return false;
+            ptr += len;
+            break;
+        default:
+            // indexed string forms would need .debug_str_offsets and unit context
+            return false;
+    }
+
+    if (value)
+        *value = v;
+
+    return true;
+}
+
+bool DwarfLineTable::ParseEntryTable(const uint8_t* &ptr, const uint8_t* end, bool is64, std::vector<std::string> &names, std::vector<uint64_t> &dirs)
+{
+    uint64_t formatCount, count, i, j;
+    std::vector<uint64_t> contentTypes, forms;
+
+    if (!ReadU(ptr, end, 1, formatCount))
+        return false;
+
+    for (i = 0; i < formatCount; i++)
+    {
+        uint64_t type, form;
+        if (!ReadULEB(ptr, end, type) || !ReadULEB(ptr, end, form))
+            return false;
+
+        contentTypes.push_back(type);
+        forms.push_back(form);
+    }
+
+    if (!ReadULEB(ptr, end, count))
+        return false;
+
+    for (i = 0; i < count; i++)
+    {
+        std::string name;
+        uint64_t dir = 0;
+
+        for (j = 0; j < formatCount; j++)
+        {
+            if (contentTypes[j] == DW_LNCT_path)
+            {
+                if (!ReadForm(ptr, end, forms[j], is64, &name, nullptr))
+                    return false;
+            }
+            else if (contentTypes[j] == DW_LNCT_directory_index)
+            {
+                if (!ReadForm(ptr, end, forms[j], is64, nullptr, &dir))
+                    return false;
+            }
+            else if (!ReadForm(ptr, end, forms[j], is64, nullptr, nullptr))
+                return false;
+        }
+
+        names.push_back(name);
+        dirs.push_back(dir);
+    }
+
+    return true;
+}
+
+bool DwarfLineTable::ParseUnit(const uint8_t* &ptr, const uint8_t* end)
+{
+    uint64_t unitLength, version, headerLength, v;
+    bool is64 = false;
+
+    if (!ReadU(ptr, end, 4, unitLength))
+        return false;
+
+    // 64-bit DWARF format
+    if (unitLength == 0xffffffff)
+    {
+        is64 = true;
+        if (!ReadU(ptr, end, 8, unitLength))
+            return false;
+    }
+
+    if ((uint64_t)(end - ptr) < unitLength)
+        return false;
+
+    const uint8_t* unitEnd = ptr + unitLength;
+    // the unit is skipped as a whole, whatever happens inside
+    const uint8_t* cur = ptr;
+    ptr = unitEnd;
+
+    if (!ReadU(cur, unitEnd, 2, version) || version < 2 || version > 5)
+        return true;
+
+    uint8_t addressSize = m_addressSize;
+    if (version >= 5)
+    {
+        if (!ReadU(cur, unitEnd, 1, v))
+            return false;
+        addressSize = (uint8_t)v;
+        // segment selector size
+        if (!ReadU(cur, unitEnd, 1, v))
+            return false;
+    }
+
+    if (!ReadU(cur, unitEnd, is64 ? 8 : 4, headerLength) || (uint64_t)(unitEnd - cur) < headerLength)
+        return false;
+
+    const uint8_t* program = cur + headerLength;
+
+    uint64_t minInstLength, defaultIsStmt, lineRange, opcodeBase;
+    int64_t lineBase;
+
+    if (!ReadU(cur, program, 1, minInstLength))
+        return false;
+    if (version >= 4 && !ReadU(cur, program, 1, v))     // maximum operations per instruction
+        return false;
+    if (!ReadU(cur, program, 1, defaultIsStmt) || !ReadU(cur, program, 1, v))
+        return false;
+    lineBase = (int8_t)v;
+    if (!ReadU(cur, program, 1, lineRange) || !ReadU(cur, program, 1, opcodeBase) || lineRange == 0 || opcodeBase == 0)
+        return false;
+
+    std::vector<uint8_t> opcodeLengths(opcodeBase, 0);
+    for (uint64_t i = 1; i < opcodeBase; i++)
+    {
+        if (!ReadU(cur, program, 1, v))
+            return false;
+        opcodeLengths[i] = (uint8_t)v;
+    }
+
+    // local file table, mapped to global file indexes
+    std::vector<uint32_t> files;
+    std::vector<std::string> dirNames, fileNames;
+    std::vector<uint64_t> dirIndexes, fileDirs;
+
+    if (version >= 5)
+    {
+        if (!ParseEntryTable(cur, program, is64, dirNames, dirIndexes) || !ParseEntryTable(cur, program, is64, fileNames, fileDirs))
+            return false;
+    }
+    else
+    {
+        const char* s;
+
+        // directory 0 is compilation directory, which is not listed here
+        dirNames.push_back("");
+        while (true)
+        {
+            if (!ReadCString(cur, program, s))
+                return false;
+            if (*s == '\0')
+                break;
+            dirNames.push_back(s);
+        }
+
+        // file indexes start from 1 in older versions
+        fileNames.push_back("");
+        fileDirs.push_back(0);
+        while (true)
+        {
+            if (!ReadCString(cur, program, s))
+                return false;
+            if (*s == '\0')
+                break;
+
+            uint64_t dir, mtime, len;
+            if (!ReadULEB(cur, program, dir) || !ReadULEB(cur, program, mtime) || !ReadULEB(cur, program, len))
+                return false;
+
+            fileNames.push_back(s);
+            fileDirs.push_back(dir);
+        }
+    }
+
+    for (size_t i = 0; i < fileNames.size(); i++)
+    {
+        std::string path = fileNames[i];
+        if (!path.empty() && path[0] != '/' && fileDirs[i] < dirNames.size() && !dirNames[fileDirs[i]].empty())
+            path = dirNames[fileDirs[i]] + "/" + path;
+
+        files.push_back(InternFile(path));
+    }
+
+    // run line number program
+    cur = program;
+
+    uint64_t address = 0, file = 1, opcode;
+    int64_t line = 1, sv;
+    size_t sequenceStart = m_rows.size();
+
+    while (cur < unitEnd)
+    {
+        opcode = *cur++;
+
+        if (opcode >= opcodeBase)
+        {
+            // special opcode - advance address and line, and append row
+            uint64_t adjusted = opcode - opcodeBase;
+            address += (adjusted / lineRange) * minInstLength;
+            line += lineBase + (int64_t)(adjusted % lineRange);
+
+            m_rows.push_back({ address, file < files.size() ? files[file] : 0, (uint32_t)line });
+        }
+        else if (opcode == 0)
+        {
+            // extended opcode
+            uint64_t len;
+            if (!ReadULEB(cur, unitEnd, len) || len == 0 || (uint64_t)(unitEnd - cur) < len)
+                return false;
+
+            const uint8_t* next = cur + len;
+            uint8_t sub = *cur++;
+
+            switch (sub)
+            {
+                case DW_LNE_end_sequence:
+                    m_rows.push_back({ address, 0, DWARF_LINE_END_SEQUENCE });
+
+                    // sequences of discarded functions start at zero (or tombstone) address; drop them
+                    if (m_rows[sequenceStart].address == 0 || m_rows[sequenceStart].address == (uint64_t)-1
+                        || (addressSize == 4 && m_rows[sequenceStart].address == 0xffffffff))
+                    {
+                        m_rows.resize(sequenceStart);
+                    }
+
+                    sequenceStart = m_rows.size();
+                    address = 0;
+                    file = 1;
+                    line = 1;
+                    break;
+                case DW_LNE_set_address:
+                    if (!ReadU(cur, next, nmin((uint64_t)addressSize, len - 1), address))
+                        return false;
+                    break;
+                default:
+                    // define_file, set_discriminator and vendor extensions are not interesting for us
+                    break;
+            }
+
+            cur = next;
+        }
+        else
+        {
+            switch (opcode)
+            {
+                case DW_LNS_copy:
+                    m_rows.push_back({ address, file < files.size() ? files[file] : 0, (uint32_t)line });
+                    break;
+                case DW_LNS_advance_pc:
+                    if (!ReadULEB(cur, unitEnd, v))
+                        return false;
+                    address += v * minInstLength;
+                    break;
+                case DW_LNS_advance_line:
+                    if (!ReadSLEB(cur, unitEnd, sv))
+                        return false;
+                    line += sv;
+                    break;
+                case DW_LNS_set_file:
+                    if (!ReadULEB(cur, unitEnd, file))
+                        return false;
+                    break;
+                case DW_LNS_const_add_pc:
+                    address += ((255 - opcodeBase) / lineRange) * minInstLength;
+                    break;
+                case DW_LNS_fixed_advance_pc:
+                    if (!ReadU(cur, unitEnd, 2, v))
+                        return false;
+                    address += v;
+                    break;
+                default:
+                    // skip operands of other standard opcodes
+                    for (uint8_t i = 0; i < opcodeLengths[opcode]; i++)
+                    {
+                        if (!ReadULEB(cur, unitEnd, v))
+                            return false;
+                    }
+                    break;
+            }
+        }
+    }
+
+    // unterminated sequence is not valid
+    m_rows.resize(sequenceStart);
+
+    return true;
+}
+
+const std::vector<line_row>& DwarfLineTable::GetRows() const
+{
+    return m_rows;
+}
+
+const char* DwarfLineTable::GetFileName(uint32_t file) const
+{
+    if (file >= m_files.size())
+        return "";
+
+    return m_files[file].c_str();
+}
+
+int64_t DwarfLineTable::FindRow(uint64_t address) const
+{
+    // find the last row with lower or equal address
+    std::vector<line_row>::const_iterator itr = std::upper_bound(m_rows.begin(), m_rows.end(), address,
+        [](uint64_t addr, const line_row &row) {
+            return addr < row.address;
+        });
+
+    if (itr == m_rows.begin())
+        return -1;
+
+    --itr;
+
+    // address falls to gap between sequences
+    if (itr->line == DWARF_LINE_END_SEQUENCE)
+        return -1;
+
+    return itr - m_rows.begin();
+}
@@ -0,0 +1,97 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_DWARF_LINES_H
+#define PIVO_GPROF_MODULE_DWARF_LINES_H
+
+#include <unordered_map>
+
+// line number used to mark end of address sequence (gap in line table); DWARF uses line 0 for code without source line as well
+#define DWARF_LINE_END_SEQUENCE 0
+
+// single row of address to line table; row covers addresses up to the next row
+struct line_row
+{
+    uint64_t address;
+    uint32_t file;
+    uint32_t line;
+};
+
+// hotness of single source line
+struct line_profile_record
+{
+    // file index (see DwarfLineTable::GetFileName)
+    uint32_t file;
+    // line number
+    uint32_t line;
+    // time spent on this line
+    double timeTotal;
+    // basic block execution count attributed to this line
+    uint64_t blockCount;
+};
+
+// address to line table read from .debug_line section of ELF binary
+class DwarfLineTable
+{
+    public:
+        DwarfLineTable();
+
+        // reads line table from supplied binary; the file is mapped to memory only while parsing
+        bool Load(const char* binaryFilename);
+        // drops loaded table
+        void Clear();
+
+        // retrieves rows sorted by address
+        const std::vector<line_row>& GetRows() const;
+        // retrieves name of file with given index
+        const char* GetFileName(uint32_t file) const;
+        // finds row covering supplied address; returns -1 if there's none
+        int64_t FindRow(uint64_t address) const;
+
+    private:
+        // parses ELF section headers and all line programs from mapped file
+        bool ParseElf(const uint8_t* data, size_t size);
+        // parses single line program unit; ptr is moved past the unit
+        bool ParseUnit(const uint8_t* &ptr, const uint8_t* end);
+        // reads file/directory entry table of DWARF 5 header
+        bool ParseEntryTable(const uint8_t* &ptr, const uint8_t* end, bool is64, std::vector<std::string> &names, std::vector<uint64_t> &dirs);
+        // reads single attribute value of given form
+        bool ReadForm(const uint8_t* &ptr, const uint8_t* end, uint64_t form, bool is64, std::string* str, uint64_t* value);
+        // retrieves global file index of supplied path
+        uint32_t InternFile(const std::string &path);
+
+        // rows sorted by address
+        std::vector<line_row> m_rows;
+        // file names, indexed by global file index
+        std::vector<std::string> m_files;
+        // file name to global index map
+        std::unordered_map<std::string, uint32_t> m_fileIndex;
+
+        // .debug_line_str section contents (valid while parsing)
+        const uint8_t* m_lineStr;
+        size_t m_lineStrSize;
+        // .debug_str section contents (valid while parsing)
+        const uint8_t* m_str;
+        size_t m_strSize;
+        // address size of parsed binary
+        uint8_t m_addressSize;
+};
+
+#endif
@@ -21,37 +21,185 @@
 #include "General.h"
 #include "Helpers.h"
 
-int ForkProcessForReading(const char** params)
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/wait.h>
+#include <errno.h>
+
+extern char **environ;
+
+ProcessReader::ProcessReader()
 {
-    int pipes[NUM_PIPES][2];
+    m_pid = -1;
+    m_fd = -1;
+    m_bufferPos = 0;
+    m_bufferEnd = 0;
+    m_eof = false;
+}
+
+ProcessReader::~ProcessReader()
+{
+    Finish();
+}
+
+bool ProcessReader::Start(const char** params)
+{
+    int pipefd[2];
+
+    // close-on-exec, so the pipe does not leak to other children spawned meanwhile
+    if (pipe2(pipefd, O_CLOEXEC) != 0)
+        return false;
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+
+    // child reads nothing and writes to our pipe
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_adddup2(&actions, pipefd[WRITE_FD], STDOUT_FILENO);
+
+    // posix_spawn does not duplicate address space of the parent process like fork does
+    int status = posix_spawn(&m_pid, params[0], &actions, nullptr, (char* const*)params, environ);
+
+    posix_spawn_file_actions_destroy(&actions);
+    close(pipefd[WRITE_FD]);
 
-    // pipes for parent to write and read
-    pipe(pipes[PARENT_READ_PIPE]);
-    pipe(pipes[PARENT_WRITE_PIPE]);
+    if (status != 0)
+    {
+        close(pipefd[READ_FD]);
+        m_pid = -1;
+        return false;
+    }
 
-    int status = fork();
+    m_fd = pipefd[READ_FD];
+    m_buffer.resize(PROCESS_READ_BLOCK_SIZE);
+    m_bufferPos = 0;
+    m_bufferEnd = 0;
+    m_eof = false;
+
+    return true;
+}
 
-    if (status == 0)
+bool ProcessReader::FillBuffer()
+{
+    if (m_eof || m_fd < 0)
+        return false;
+
+    // move unprocessed data to the beginning of buffer
+    if (m_bufferPos > 0)
     {
-        dup2(CHILD_READ_FD(pipes), STDIN_FILENO);
-        dup2(CHILD_WRITE_FD(pipes), STDOUT_FILENO);
+        memmove(&m_buffer[0], &m_buffer[m_bufferPos], m_bufferEnd - m_bufferPos);
+        m_bufferEnd -= m_bufferPos;
+        m_bufferPos = 0;
+    }
 
-        close(CHILD_READ_FD(pipes));
-        close(CHILD_WRITE_FD(pipes));
-        close(PARENT_READ_FD(pipes));
-        close(PARENT_WRITE_FD(pipes));
+    // grow buffer, if the unfinished line fills it whole (keep one byte for terminating zero)
+    if (m_bufferEnd + 1 >= m_buffer.size())
+        m_buffer.resize(m_buffer.size() * 2);
 
-        execv(params[0], (char* const*)params);
+    ssize_t res;
+    do
+    {
+        res = read(m_fd, &m_buffer[m_bufferEnd], m_buffer.size() - m_bufferEnd - 1);
+    } while (res < 0 && errno == EINTR);
+
+    if (res <= 0)
+    {
+        m_eof = true;
+        return false;
     }
-    else if (status > 0)
+
+    m_bufferEnd += res;
+    return true;
+}
+
+bool ProcessReader::ReadLine(char*& line, size_t& length)
+{
+    size_t scanPos = m_bufferPos;
+
+    while (true)
     {
-        close(CHILD_READ_FD(pipes));
-        close(CHILD_WRITE_FD(pipes));
+        // look for end of line in data we already have
+        char* start = m_buffer.empty() ? nullptr : &m_buffer[0];
+        char* eol = (scanPos < m_bufferEnd) ? (char*)memchr(start + scanPos, '\n', m_bufferEnd - scanPos) : nullptr;
+
+        if (eol)
+        {
+            line = start + m_bufferPos;
+            length = eol - line;
+            *eol = '\0';
+
+            // strip carriage return, if any
+            if (length > 0 && line[length - 1] == '\r')
+                line[--length] = '\0';
+
+            m_bufferPos = (eol - start) + 1;
+            return true;
+        }
+
+        // whole pending data were already scanned
+        size_t pending = m_bufferEnd - m_bufferPos;
+
+        if (!FillBuffer())
+        {
+            // return the last unterminated line, if any
+            if (pending == 0)
+                return false;
 
-        close(PARENT_WRITE_FD(pipes));
+            line = &m_buffer[m_bufferPos];
+            length = pending;
+            line[length] = '\0';
+            m_bufferPos = m_bufferEnd;
+            return true;
+        }
+
+        // data were moved to buffer start, continue scanning where we stopped
+        scanPos = m_bufferPos + pending;
+    }
+}
+
+int ProcessReader::Finish()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+        m_fd = -1;
     }
-    else
+
+    if (m_pid <= 0)
         return -1;
 
-    return PARENT_READ_FD(pipes);
+    // reap the child, so it does not stay zombie
+    int status;
+    pid_t res;
+    do
+    {
+        res = waitpid(m_pid, &status, 0);
+    } while (res < 0 && errno == EINTR);
+
+    m_pid = -1;
+
+    if (res < 0 || !WIFEXITED(status))
+        return -1;
+
+    return WEXITSTATUS(status);
+}
+
+bool ParseNmLine(char* line, size_t length, uint64_t &address, char &type, char* &name)
+{
+    char* endptr;
+
+    // require some minimal length, parsing would fail anyway
+    if (length < 8)
+        return false;
+
+    // parse address; lines of undefined symbols do not have any
+    address = strtoull(line, &endptr, 16);
+    if (endptr == line || (size_t)(endptr - line) + 3 > length)
+        return false;
+
+    // address is followed by space, symbol type, space and symbol name
+    type = *(endptr + 1);
+    name = endptr + 3;
+
+    return true;
 }
@@ -0,0 +1,300 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Helpers.h"
+#include "Gmon.h"
+#include "FunctionOrder.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+#include "../config_gprof.h"
+
+#include <algorithm>
+#include <unordered_map>
+
+FunctionOrder::FunctionOrder()
+{
+    //
+}
+
+uint32_t FunctionOrder::FindCluster(uint32_t function)
+{
+    while (m_clusterParent[function] != function)
+    {
+        m_clusterParent[function] = m_clusterParent[m_clusterParent[function]];
+        function = m_clusterParent[function];
+    }
+
+    return function;
+}
+
+void FunctionOrder::Build(const std::vector<FunctionEntry> &functions, const std::vector<FlatProfileRecord> &flatProfile,
+    const CallGraphMap &callGraph, uint32_t maxClusterSize)
+{
+    LogGated(LOG_VERBOSE, "Building function order using call-chain clustering");
+
+    uint32_t i, count = (uint32_t)functions.size();
+
+    m_hotOrder.clear();
+    m_coldOrder.clear();
+
+    m_clusterParent.resize(count);
+    m_clusterNext.assign(count, FUNCTION_ORDER_NONE);
+    m_clusterTail.resize(count);
+    m_clusterSize.resize(count);
+    m_clusterWeight.assign(count, 0.0);
+
+    // every function starts in its own cluster; its size is the distance to the next symbol
+    for (i = 0; i < count; i++)
+    {
+        m_clusterParent[i] = i;
+        m_clusterTail[i] = i;
+        m_clusterSize[i] = (i + 1 < count && functions[i + 1].address > functions[i].address) ? functions[i + 1].address - functions[i].address : 1;
+    }
+
+    // use self time as the weight; when there's no time information at all, fall back to call counts
+    bool useTime = false;
+    for (i = 0; i < flatProfile.size(); i++)
+    {
+        if (flatProfile[i].timeTotal > 0.0)
+        {
+            useTime = true;
+            break;
+        }
+    }
+
+    std::vector<uint32_t> nodes;
+    std::vector<bool> isNode(count, false);
+
+    for (i = 0; i < flatProfile.size(); i++)
+    {
+        uint32_t fid = flatProfile[i].functionId;
+        if (fid >= count || functions[fid].functionType != FET_TEXT)
+            continue;
+
+        m_clusterWeight[fid] = useTime ? flatProfile[i].timeTotal : (double)flatProfile[i].callCount;
+        if (!isNode[fid])
+        {
+            isNode[fid] = true;
+            nodes.push_back(fid);
+        }
+    }
+
+    // find the heaviest caller of every function - single pass over all arcs
+    std::vector<uint32_t> bestCaller(count, FUNCTION_ORDER_NONE);
+    std::vector<uint64_t> bestCount(count, 0);
+
+    for (CallGraphMap::const_iterator itr = callGraph.begin(); itr != callGraph.end(); ++itr)
+    {
+        if (itr->first >= count || functions[itr->first].functionType != FET_TEXT)
+            continue;
+
+        // callers take part in clustering even without samples of their own
+        if (!isNode[itr->first])
+        {
+            isNode[itr->first] = true;
+            nodes.push_back(itr->first);
+        }
+
+        for (std::map<uint32_t, uint64_t>::const_iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
+        {
+            if (sitr->first < count && sitr->second > bestCount[sitr->first])
+            {
+                bestCount[sitr->first] = sitr->second;
+                bestCaller[sitr->first] = itr->first;
+            }
+        }
+    }
+
+    // process functions from the hottest to the coldest
+    std::sort(nodes.begin(), nodes.end(), [this](uint32_t a, uint32_t b) {
+        if (m_clusterWeight[a] != m_clusterWeight[b])
+            return m_clusterWeight[a] > m_clusterWeight[b];
+        return a < b;
+    });
+
+    uint32_t f, caller, fc, cc;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        f = nodes[n];
+        caller = bestCaller[f];
+
+        if (caller == FUNCTION_ORDER_NONE || caller == f || !isNode[caller])
+            continue;
+
+        fc = FindCluster(f);
+        cc = FindCluster(caller);
+
+        if (fc == cc || m_clusterSize[fc] + m_clusterSize[cc] > maxClusterSize)
+            continue;
+
+        // do not merge, if it would significantly lower density of the caller cluster
+        double fcDensity = m_clusterWeight[fc] / (double)m_clusterSize[fc];
+        double ccDensity = m_clusterWeight[cc] / (double)m_clusterSize[cc];
+        double mergedDensity = (m_clusterWeight[fc] + m_clusterWeight[cc]) / (double)(m_clusterSize[fc] + m_clusterSize[cc]);
+        if (mergedDensity * 8.0 < ccDensity && fcDensity < ccDensity)
+            continue;
+
+        // append callee cluster right after the caller cluster
+        m_clusterNext[m_clusterTail[cc]] = fc;
+        m_clusterTail[cc] = m_clusterTail[fc];
+        m_clusterSize[cc] += m_clusterSize[fc];
+        m_clusterWeight[cc] += m_clusterWeight[fc];
+        m_clusterParent[fc] = cc;
+    }
+
+    // collect cluster heads and order them by density
+    std::vector<uint32_t> heads;
+    for (size_t n = 0; n < nodes.size(); n++)
+    {
+        if (m_clusterParent[nodes[n]] == nodes[n] && m_clusterWeight[nodes[n]] > 0.0)
+            heads.push_back(nodes[n]);
+    }
+
+    std::sort(heads.begin(), heads.end(), [this](uint32_t a, uint32_t b) {
+        double da = m_clusterWeight[a] / (double)m_clusterSize[a];
+        double db = m_clusterWeight[b] / (double)m_clusterSize[b];
+        if (da != db)
+            return da > db;
+        return a < b;
+    });
+
+    std::vector<bool> placed(count, false);
+    for (size_t h = 0; h < heads.size(); h++)
+    {
+        for (f = heads[h]; f != FUNCTION_ORDER_NONE; f = m_clusterNext[f])
+        {
+            m_hotOrder.push_back(f);
+            placed[f] = true;
+        }
+    }
+
+    // everything else is cold, kept in address order
+    for (i = 0; i < count; i++)
+    {
+        if (!placed[i] && functions[i].functionType == FET_TEXT)
+            m_coldOrder.push_back(i);
+    }
+
+    LogGated(LOG_VERBOSE, "Function order contains %llu hot functions in %llu clusters, %llu cold functions",
+        (unsigned long long)m_hotOrder.size(), (unsigned long long)heads.size(), (unsigned long long)m_coldOrder.size());
+}
+
+const std::vector<uint32_t>& FunctionOrder::GetHotOrder() const
+{
+    return m_hotOrder;
+}
+
+const std::vector<uint32_t>& FunctionOrder::GetColdOrder() const
+{
+    return m_coldOrder;
+}
+
+bool FunctionOrder::ResolveRawNames(const char* binaryFilename, const std::vector<FunctionEntry> &functions, std::vector<std::string> &names)
+{
+    // function table contains demangled names, but linker needs raw symbol names; nm is called without -C here
+    const char *argv[] = {NM_BINARY_PATH, "-a", binaryFilename, 0};
+
+    ProcessReader nm;
+
+    if (!nm.Start(argv))
+    {
+        LogFunc(LOG_ERROR, "Could not execute nm binary for raw symbol names");
+        return false;
+    }
+
+    // map addresses to functions we are interested in
+    std::unordered_map<uint64_t, uint32_t> addressMap;
+    for (size_t i = 0; i < m_hotOrder.size(); i++)
+        addressMap[functions[m_hotOrder[i]].address] = m_hotOrder[i];
+    for (size_t i = 0; i < m_coldOrder.size(); i++)
+        addressMap[functions[m_coldOrder[i]].address] = m_coldOrder[i];
+
+    names.assign(functions.size(), std::string());
+
+    char* line;
+    size_t length;
+    uint64_t laddr;
+    char* name;
+    char type;
+
+    while (nm.ReadLine(line, length))
+    {
+        if (!ParseNmLine(line, length, laddr, type, name))
+            continue;
+
+        // only text symbols; the first one wins in case of aliases
+        if (type != 'T' && type != 't')
+            continue;
+
+        std::unordered_map<uint64_t, uint32_t>::iterator itr = addressMap.find(laddr);
+        if (itr != addressMap.end() && names[itr->second].empty())
+            names[itr->second] = name;
+    }
+
+    nm.Finish();
+
+    return true;
+}
+
+bool FunctionOrder::WriteList(const char* filename, const std::vector<uint32_t> &list, const std::vector<std::string> &names, FunctionOrderFormat format)
+{
+    FILE* f = fopen(filename, "w");
+    if (!f)
+    {
+        LogFunc(LOG_ERROR, "Could not open %s for writing", filename);
+        return false;
+    }
+
+    for (size_t i = 0; i < list.size(); i++)
+    {
+        const std::string &name = names[list[i]];
+        if (name.empty())
+            continue;
+
+        if (format == FOF_SECTIONS)
+            fprintf(f, ".text.%s\n", name.c_str());
+        else
+            fprintf(f, "%s\n", name.c_str());
+    }
+
+    fclose(f);
+    return true;
+}
+
+bool FunctionOrder::Write(const char* binaryFilename, const std::vector<FunctionEntry> &functions,
+    const char* hotFilename, const char* coldFilename, FunctionOrderFormat format)
+{
+    std::vector<std::string> names;
+
+    if (!ResolveRawNames(binaryFilename, functions, names))
+        return false;
+
+    if (hotFilename && !WriteList(hotFilename, m_hotOrder, names, format))
+        return false;
+
+    if (coldFilename && !WriteList(coldFilename, m_coldOrder, names, format))
+        return false;
+
+    LogGated(LOG_VERBOSE, "Function order written");
+
+    return true;
+}
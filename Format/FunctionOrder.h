@@ -0,0 +1,86 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_FUNCTION_ORDER_H
+#define PIVO_GPROF_MODULE_FUNCTION_ORDER_H
+
+#include "UnitIdentifiers.h"
+#include "FlatProfileStructs.h"
+#include "CallGraphStructs.h"
+
+// terminator of cluster chains
+#define FUNCTION_ORDER_NONE ((uint32_t)-1)
+
+// default maximum size of merged cluster (one page)
+#define FUNCTION_ORDER_DEFAULT_CLUSTER_SIZE 4096
+
+// format of emitted order file
+enum FunctionOrderFormat
+{
+    FOF_SYMBOLS = 0,        // plain symbol names (lld --symbol-ordering-file)
+    FOF_SECTIONS = 1        // .text.<symbol> section names (gold --section-ordering-file)
+};
+
+// builds function layout using call-chain clustering (C3) of processed profile
+class FunctionOrder
+{
+    public:
+        FunctionOrder();
+
+        // computes hot function order and cold function list; flat profile has to be sorted by function ID
+        void Build(const std::vector<FunctionEntry> &functions, const std::vector<FlatProfileRecord> &flatProfile,
+            const CallGraphMap &callGraph, uint32_t maxClusterSize = FUNCTION_ORDER_DEFAULT_CLUSTER_SIZE);
+
+        // writes hot and cold lists to files using symbol names resolved from supplied binary
+        bool Write(const char* binaryFilename, const std::vector<FunctionEntry> &functions,
+            const char* hotFilename, const char* coldFilename, FunctionOrderFormat format = FOF_SYMBOLS);
+
+        // retrieves hot functions in layout order
+        const std::vector<uint32_t>& GetHotOrder() const;
+        // retrieves cold functions in address order
+        const std::vector<uint32_t>& GetColdOrder() const;
+
+    private:
+        // finds cluster containing given function (union-find with path halving)
+        uint32_t FindCluster(uint32_t function);
+
+        // retrieves raw (mangled) symbol names of ordered functions from binary
+        bool ResolveRawNames(const char* binaryFilename, const std::vector<FunctionEntry> &functions, std::vector<std::string> &names);
+        // writes single list of functions to file
+        bool WriteList(const char* filename, const std::vector<uint32_t> &list, const std::vector<std::string> &names, FunctionOrderFormat format);
+
+        // cluster parent of every function (union-find forest)
+        std::vector<uint32_t> m_clusterParent;
+        // next function in cluster chain, or FUNCTION_ORDER_NONE
+        std::vector<uint32_t> m_clusterNext;
+        // last function of cluster chain (valid for cluster heads)
+        std::vector<uint32_t> m_clusterTail;
+        // cluster size in bytes (valid for cluster heads)
+        std::vector<uint64_t> m_clusterSize;
+        // cluster weight (valid for cluster heads)
+        std::vector<double> m_clusterWeight;
+
+        // resulting hot function order
+        std::vector<uint32_t> m_hotOrder;
+        // resulting cold function list
+        std::vector<uint32_t> m_coldOrder;
+};
+
+#endif
@@ -0,0 +1,138 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "FunctionSamples.h"
+
+#include <algorithm>
+
+FunctionSampleTable::FunctionSampleTable()
+{
+    //
+}
+
+void FunctionSampleTable::Clear()
+{
+    // keep arena capacity for next load
+    m_arena.clear();
+    m_slices.clear();
+}
+
+void FunctionSampleTable::Add(uint32_t functionId, uint32_t offset, uint32_t size, double samples)
+{
+    // bins are walked in address order, so the samples of one function mostly come one after another
+    if (m_slices.empty() || m_slices.back().functionId != functionId)
+        m_slices.push_back({ functionId, (uint32_t)m_arena.size(), 0 });
+
+    m_arena.push_back({ offset, size, samples });
+    m_slices.back().count++;
+}
+
+void FunctionSampleTable::Finish()
+{
+    size_t i, j;
+
+    bool sorted = true;
+    for (i = 1; i < m_slices.size() && sorted; i++)
+        sorted = m_slices[i - 1].functionId < m_slices[i].functionId;
+
+    // single histogram record (the usual case) produces slices already ordered by function
+    if (sorted)
+        return;
+
+    // functions are split into more slices by multiple histogram records, or the records are not ordered;
+    // put slices of every function together in new arena
+    std::stable_sort(m_slices.begin(), m_slices.end(), [](const function_slice &a, const function_slice &b) {
+        return a.functionId < b.functionId;
+    });
+
+    m_scratch.clear();
+    m_scratch.reserve(m_arena.size());
+
+    size_t last = 0;
+    for (i = 0; i < m_slices.size(); i++)
+    {
+        // merged slices are written over the sorted ones, so take a copy
+        function_slice slice = m_slices[i];
+
+        if (i == 0 || slice.functionId != m_slices[last].functionId)
+        {
+            if (i > 0)
+                last++;
+            m_slices[last] = { slice.functionId, (uint32_t)m_scratch.size(), 0 };
+        }
+
+        m_slices[last].count += slice.count;
+        for (j = 0; j < slice.count; j++)
+            m_scratch.push_back(m_arena[slice.first + j]);
+    }
+
+    m_slices.resize(m_slices.empty() ? 0 : last + 1);
+
+    for (i = 0; i < m_slices.size(); i++)
+    {
+        std::sort(m_scratch.begin() + m_slices[i].first, m_scratch.begin() + m_slices[i].first + m_slices[i].count,
+            [](const function_sample &a, const function_sample &b) {
+                return a.offset < b.offset;
+            });
+    }
+
+    m_arena.swap(m_scratch);
+    m_scratch.clear();
+}
+
+const function_sample* FunctionSampleTable::GetSamples(uint32_t functionId, uint32_t &count) const
+{
+    std::vector<function_slice>::const_iterator itr = std::lower_bound(m_slices.begin(), m_slices.end(), functionId,
+        [](const function_slice &slice, uint32_t value) {
+            return slice.functionId < value;
+        });
+
+    if (itr == m_slices.end() || itr->functionId != functionId)
+    {
+        count = 0;
+        return nullptr;
+    }
+
+    count = itr->count;
+    return &m_arena[itr->first];
+}
+
+void FunctionSampleTable::GetHottest(uint32_t functionId, uint32_t count, std::vector<function_sample> &dst) const
+{
+    uint32_t sampleCount;
+    const function_sample* samples = GetSamples(functionId, sampleCount);
+
+    dst.clear();
+    if (!samples)
+        return;
+
+    dst.assign(samples, samples + sampleCount);
+
+    // the most samples first, lower offsets first among equal ones
+    size_t top = nmin((size_t)count, dst.size());
+    std::partial_sort(dst.begin(), dst.begin() + top, dst.end(), [](const function_sample &a, const function_sample &b) {
+        if (a.samples != b.samples)
+            return a.samples > b.samples;
+        return a.offset < b.offset;
+    });
+
+    dst.resize(top);
+}
@@ -0,0 +1,73 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_FUNCTION_SAMPLES_H
+#define PIVO_GPROF_MODULE_FUNCTION_SAMPLES_H
+
+// samples of part of histogram bin within function
+struct function_sample
+{
+    // offset of covered address range from function start, in bytes
+    uint32_t offset;
+    // size of covered address range, in bytes
+    uint32_t size;
+    // samples credited to the function from this bin
+    double samples;
+};
+
+// distribution of samples within bodies of functions; samples of all functions are stored in single arena,
+// every function with any samples owns continuous slice of it, ordered by offset
+class FunctionSampleTable
+{
+    public:
+        FunctionSampleTable();
+
+        // adds samples of bin part within function; bins of one function are expected to come in address order
+        void Add(uint32_t functionId, uint32_t offset, uint32_t size, double samples);
+        // finishes table once all histograms were attributed
+        void Finish();
+        // drops all samples, keeps allocated storage
+        void Clear();
+
+        // retrieves samples of function ordered by offset; returns null if the function has no samples
+        const function_sample* GetSamples(uint32_t functionId, uint32_t &count) const;
+        // fills at most count hottest address ranges of function, the hottest first
+        void GetHottest(uint32_t functionId, uint32_t count, std::vector<function_sample> &dst) const;
+
+    private:
+        // arena slice owned by function
+        struct function_slice
+        {
+            uint32_t functionId;
+            // index of first sample in arena
+            uint32_t first;
+            // count of samples
+            uint32_t count;
+        };
+
+        // samples of all functions
+        std::vector<function_sample> m_arena;
+        // slices of arena, sorted by function ID once finished
+        std::vector<function_slice> m_slices;
+        // scratch storage for reordering arena
+        std::vector<function_sample> m_scratch;
+};
+
+#endif
@@ -19,324 +19,282 @@
  **/
 
 #include "General.h"
-#include "Helpers.h"
 #include "Gmon.h"
+#include "FunctionOrder.h"
+#include "PprofExport.h"
+#include "GmonWriter.h"
 #include "GprofInputModule.h"
 #include "Log.h"
-#include "../config_gprof.h"
+#include "LogGate.h"
 
 #include <algorithm>
+#include <thread>
 #include <math.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 GmonFile::GmonFile()
 {
-    for (int i = 0; i < MAX_GMON_REC_TYPE; i++)
-        m_tagCount[i] = 0;
+    m_progress = nullptr;
+    m_symbolFilter = nullptr;
+    m_arcMemoryBudget = 0;
+    m_fileData = nullptr;
+    m_fileSize = 0;
+    m_fileMapping = nullptr;
+
+    Reset();
 }
 
-GmonFile* GmonFile::Load(const char* filename, const char* binaryFilename)
+GmonFile::~GmonFile()
 {
-    LogFunc(LOG_VERBOSE, "Loading gmon file %s", filename);
+    //
+}
 
-    // open file
-    FILE* gf = fopen(filename, "rb");
-    if (!gf)
-    {
-        LogFunc(LOG_ERROR, "Couldn't find gmon file %s", filename);
-        return nullptr;
-    }
-
-    FILE* tmpbf = fopen(binaryFilename, "rb");
-    if (!tmpbf)
-        LogFunc(LOG_ERROR, "Invalid binary file %s supplied, won't be possible to resolve symbols!", binaryFilename);
-    else
-        fclose(tmpbf);
+void GmonFile::Reset()
+{
+    // keep file buffer and record index capacity for next load
+    ReleaseFileData();
+    m_records.clear();
 
-    GmonFile* gmon = new GmonFile();
+    m_binaryFilename.clear();
+    m_binaryIdentity = binary_identity();
 
-    gmon->m_file = gf;
-
-    LogFunc(LOG_VERBOSE, "Reading gmon file header");
+    for (int i = 0; i < MAX_GMON_REC_TYPE; i++)
+        m_tagCount[i] = 0;
 
-    // read raw header
-    if (fread(&gmon->m_header, sizeof(gmon_header), 1, gmon->m_file) != 1)
-    {
-        LogFunc(LOG_ERROR, "File does not contain valid gmon header");
-        fclose(gmon->m_file);
-        delete gmon;
-        return nullptr;
-    }
+    m_fileVersion = 0;
+    m_profRate = 0;
+    m_histDimension.clear();
+    m_histDimensionAbbrev = 0;
 
-    // verify magic cookie
-    if (strncmp(gmon->m_header.cookie, GMON_MAGIC, 4) != 0)
+    // return sample buffers to pool, so the next load could reuse them
+    for (size_t i = 0; i < m_histograms.size(); i++)
     {
-        LogFunc(LOG_ERROR, "File does not contain valid gmon magic cookie");
-        fclose(gmon->m_file);
-        delete gmon;
-        return nullptr;
+        m_samplePool.push_back(std::vector<int>());
+        m_samplePool.back().swap(m_histograms[i].sample);
     }
 
-    // TODO: platform-dependent endianity
-    // convert character-based version to integer as-is
-    gmon->m_fileVersion = *((uint32_t*)gmon->m_header.version);
-
-    // TODO: verify supported file version ( <= GMON_VERSION ) - TODO: verify version numbering and compatibility
-
-    gmon->ResolveSymbols(binaryFilename);
+    // clearing vectors keeps their capacity for next load
+    m_histograms.clear();
+    m_callGraphArcs.clear();
+    m_arcSpill.Clear();
+    m_basicBlocks.clear();
+    m_symbols = SymbolTableRegistry::GetEmpty();
+    m_flatProfile.clear();
+    m_flatProfileSlots.clear();
+    m_functionSamples.Clear();
+    m_callGraph.clear();
+    m_callSites.Clear();
+    m_classProfile.clear();
+    m_callChains.Clear();
+    m_histogramPyramid.Clear();
+    m_sampleIndex.Clear();
+    m_lineTable.Clear();
+    m_lineProfile.clear();
+}
 
-    uint8_t tag;
+GmonFile* GmonFile::Load(const char* filename, const char* binaryFilename, GmonLoadProgress* progress, const SymbolFilter* filter,
+    uint64_t arcMemoryBudget)
+{
+    GmonFile* gmon = new GmonFile();
 
-    // read all available records - read tag, and then call appropriate method reading the record
-    while (fread(&tag, sizeof(tag), 1, gmon->m_file) == 1)
-    {
-        switch (tag)
-        {
-            // histogram record
-            case GMON_TAG_TIME_HIST:
-                LogFunc(LOG_DEBUG, "Reading histogram record");
-                gmon->ReadHistogramRecord();
-                break;
-            // call-graph record
-            case GMON_TAG_CG_ARC:
-                LogFunc(LOG_DEBUG, "Reading call-graph record");
-                gmon->ReadCallGraphRecord();
-                break;
-            // basic block record
-            case GMON_TAG_BB_COUNT:
-                LogFunc(LOG_DEBUG, "Reading basic block record");
-                gmon->ReadBasicBlockRecord();
-                break;
-            // anything else is considered an error
-            default:
-                LogFunc(LOG_ERROR, "File contains invalid tag: %i", tag);
-                fclose(gmon->m_file);
-                delete gmon;
-                return nullptr;
-        }
+    if (!gmon->Reload(filename, binaryFilename, progress, filter, arcMemoryBudget))
+    {
+        delete gmon;
+        return nullptr;
     }
 
-    // cleanup
-    fclose(gmon->m_file);
-
-    // report record counts to log
-    LogFunc(LOG_VERBOSE, "gmon file loaded, %llu histogram records, %llu call-graph records, %llu basic block records",
-        gmon->m_tagCount[GMON_TAG_TIME_HIST], gmon->m_tagCount[GMON_TAG_CG_ARC], gmon->m_tagCount[GMON_TAG_BB_COUNT]);
-
-    // perform scaling of function entries
-    gmon->ScaleAndAlignEntries();
-
-    gmon->ProcessFlatProfile();
-
-    gmon->ProcessCallGraph();
-
-    return gmon;
+    return gmon;
 }
 
-void GmonFile::ResolveSymbols(const char* binaryFilename)
+bool GmonFile::Reload(const char* filename, const char* binaryFilename, GmonLoadProgress* progress, const SymbolFilter* filter,
+    uint64_t arcMemoryBudget)
 {
-    // build nm binary call parameters
-    const char *argv[] = {NM_BINARY_PATH, "-a", "-C", binaryFilename, 0};
-
-    LogFunc(LOG_VERBOSE, "Reasolving symbols using application binary");
-
-    int readfd = ForkProcessForReading(argv);
-
-    if (readfd <= 0)
-    {
-        LogFunc(LOG_ERROR, "Could not execute nm binary for symbol resolving, no symbols loaded");
-        return;
-    }
-
-    // buffer for reading lines from nm stdout
-    char buffer[256];
-
-    // Read from child’s stdout
-    int res, pos, cnt;
-    char c;
-    uint64_t laddr;
-    char* endptr;
-    char fncType;
-
-    cnt = 0;
-
-    // line reading loop - terminated by file end
-    while (true)
-    {
-        pos = 0;
-        while ((res = read(readfd, &c, sizeof(char))) == 1)
-        {
-            // stop reading line when end of line character is acquired
-            if (c == 10 || c == 13)
-                break;
-
-            // read only 255 characters, strip the rest
-            if (pos < 255)
-                buffer[pos++] = c;
-        }
-
-        // this both means end of file - eighter no character was read, or we reached zero character
-        if (res <= 0 || c == 0)
-            break;
-
-        // properly null-perminate string
-        buffer[pos] = 0;
-
-        // require some minimal length, parsing would fail anyway
-        if (strlen(buffer) < 8)
-            continue;
-
-        // parse address
-        laddr = strtoull(buffer, &endptr, 16);
-        if (endptr - buffer + 2 > pos)
-            break;
+    // drop previous contents, but keep allocated storage
+    Reset();
 
-        // resolve function type
-        fncType = *(endptr+1);
-        if (fncType == 'T' || fncType == 't')
-            fncType = FET_TEXT;
-        else
-            fncType = FET_MISC;
+    m_progress = progress;
+    m_symbolFilter = (filter && !filter->IsEmpty()) ? filter : nullptr;
+    m_arcMemoryBudget = arcMemoryBudget;
 
-        // store "the rest of line" as function name to function table
-        m_functionTable.push_back({ laddr, 0, endptr+3, NO_CLASS, (FunctionEntryType)fncType });
-        cnt++;
+    bool result = LoadContents(filename, binaryFilename);
 
-        // This logging call usually fills console with loads of messages; commented out for sanity reasons
-        //LogFunc(LOG_VERBOSE, "Address: %llu, function: %s", laddr, m_functionTable[laddr].c_str());
-    }
+    if (m_progress)
+        m_progress->stage = result ? GLS_DONE : (IsCancelled() ? GLS_CANCELLED : GLS_FAILED);
 
-    close(readfd);
+    m_progress = nullptr;
+    m_symbolFilter = nullptr;
+    m_arcMemoryBudget = 0;
 
-    // sort function entries to allow effective search
-    std::sort(m_functionTable.begin(), m_functionTable.end(), FunctionEntrySortPredicate());
+    // do not leave partially loaded data behind
+    if (!result)
+        Reset();
 
-    LogFunc(LOG_VERBOSE, "Loaded %i symbols from supplied binary file", cnt);
+    return result;
 }
 
-FunctionEntry* GmonFile::GetFunctionByAddress(uint64_t address, uint32_t* functionIndex, bool useScaled)
+bool GmonFile::IsCancelled() const
 {
-    if (functionIndex)
-        *functionIndex = 0;
-
-    if (m_functionTable.empty())
-        return nullptr;
-
-    // we assume that m_functionTable is sorted from lower address to higher
-    // so we are able to perform binary search in O(log(n)) complexity
-
-    uint64_t ilow, ihigh, imid;
+    return m_progress && m_progress->cancelRequested.load(std::memory_order_relaxed);
+}
 
-    ilow = 0;
-    ihigh = m_functionTable.size() - 1;
+void GmonFile::SetStage(GmonLoadStage stage)
+{
+    if (m_progress)
+        m_progress->stage = stage;
+}
 
-    imid = (ilow + ihigh) / 2;
+bool GmonFile::LoadContents(const char* filename, const char* binaryFilename)
+{
+    LogGated(LOG_VERBOSE, "Loading gmon file %s", filename);
 
-    // iterative binary search
-    while (ilow <= ihigh)
+    if (m_arcMemoryBudget)
     {
-        if ((useScaled ? m_functionTable[imid].scaled_address : m_functionTable[imid].address) > address)
-            ihigh = imid - 1;
-        else
-            ilow = imid + 1;
-
-        imid = (ilow + ihigh) / 2;
+        // map the file, so the pages of already processed arcs could be dropped
+        if (!MapFileData(filename))
+            return false;
     }
-
-    // the outcome may be one step higher (depending from which side we arrived), than we would like to have - we are looking for
-    // "highest lower address", i.e. for addresses 2, 5, 10, and input address 7, we return entry with address 5
-
-    if ((useScaled ? m_functionTable[ilow].scaled_address : m_functionTable[ilow].address) <= address)
+    else
     {
-        if (functionIndex)
-            *functionIndex = ilow;
-        return &m_functionTable[ilow];
+        // read whole file to memory, so it could be indexed and decoded in parallel
+        if (!ReadFileData(filename))
+            return false;
     }
 
-    if (functionIndex)
-        *functionIndex = ilow - 1;
+    if (m_progress)
+        m_progress->bytesTotal = m_fileSize;
 
-    return &m_functionTable[ilow - 1];
-}
+    FILE* tmpbf = fopen(binaryFilename, "rb");
+    if (!tmpbf)
+        LogFunc(LOG_ERROR, "Invalid binary file %s supplied, won't be possible to resolve symbols!", binaryFilename);
+    else
+        fclose(tmpbf);
+
+    LogGated(LOG_VERBOSE, "Reading gmon file header");
+
+    // read raw header
+    if (m_fileSize < sizeof(gmon_header))
+    {
+        LogFunc(LOG_ERROR, "File does not contain valid gmon header");
+        return false;
+    }
+
+    memcpy(&m_header, m_fileData, sizeof(gmon_header));
+
+    // verify magic cookie
+    if (strncmp(m_header.cookie, GMON_MAGIC, 4) != 0)
+    {
+        LogFunc(LOG_ERROR, "File does not contain valid gmon magic cookie");
+        return false;
+    }
+
+    // TODO: platform-dependent endianity
+    // convert character-based version to integer as-is
+    m_fileVersion = *((uint32_t*)m_header.version);
+
+    // TODO: verify supported file version ( <= GMON_VERSION ) - TODO: verify version numbering and compatibility
 
-void GmonFile::GetFunctionListByAddressRange(uint64_t lowpc, uint64_t highpc, std::list<uint32_t>* indexList, bool useScaled)
-{
-    if (lowpc > highpc)
-        return;
+    // index and validate all records before any heavy work starts
+    if (!ScanRecords())
+        return false;
+
+    m_binaryFilename = binaryFilename;
+    IdentifyBinary(binaryFilename, m_binaryIdentity);
+
+    SetStage(GLS_SYMBOLS);
 
-    if (!indexList)
-        return;
+    // symbols of the same binary are resolved just once and shared by all loads
+    m_symbols = SymbolTableRegistry::GetInstance().Acquire(binaryFilename, m_symbolFilter, m_progress);
+    if (!m_symbols)
+        return false;
 
-    indexList->clear();
+    SetStage(GLS_RECORDS);
 
-    uint32_t ind;
-    FunctionEntry* fe;
+    if (!DecodeRecords())
+        return false;
 
-    fe = GetFunctionByAddress(lowpc, &ind, useScaled);
+    // raw file contents are no longer needed
+    ReleaseFileData();
 
-    while (fe && ((!useScaled && fe->address < highpc) || (useScaled && fe->scaled_address < highpc)))
-    {
-        indexList->push_back(ind);
+    MergeBasicBlocks();
 
-        ++ind;
+    if (m_progress)
+        m_progress->bytesRead = m_progress->bytesTotal.load();
 
-        if (ind == m_functionTable.size())
-            fe = nullptr;
-        else
-            fe = &m_functionTable[ind];
-    }
-}
+    if (IsCancelled())
+        return false;
 
-void GmonFile::ScaleAndAlignEntries()
-{
-    // This method is now used just for aligning function entries to "measurable scale",
-    // no more functionality for now
+    // report record counts to log
+    LogGated(LOG_VERBOSE, "gmon file loaded, %llu histogram records, %llu call-graph records, %llu basic block records",
+        m_tagCount[GMON_TAG_TIME_HIST], m_tagCount[GMON_TAG_CG_ARC], m_tagCount[GMON_TAG_BB_COUNT]);
 
-    LogFunc(LOG_VERBOSE, "Scaling and aligning function entries");
+    SetStage(GLS_HISTOGRAMS);
 
-    int i;
+    if (!ProcessFlatProfile())
+        return false;
 
-    for (i = 0; i < m_functionTable.size(); i++)
-    {
-        // scale address by profiling unit
-        m_functionTable[i].scaled_address = m_functionTable[i].address / sizeof(UNIT);
-    }
+    // aggregate flat profile of classes, functions have their classes assigned already
+    m_symbols->GetClassTable().BuildProfile(m_symbols->GetFunctions(), m_flatProfile, m_classProfile);
+
+    SetStage(GLS_CALL_GRAPH);
+
+    if (!ProcessCallGraph())
+        return false;
+
+    // build heat map pyramid from merged histograms
+    m_histogramPyramid.Build(m_histograms);
+    // build prefix sums for address range queries
+    m_sampleIndex.Build(m_histograms);
+
+    return true;
 }
 
-void GmonFile::AssignHistogramEntries(histogram* hist)
+bool GmonFile::AssignHistogramEntries(histogram* hist)
 {
-    LogFunc(LOG_DEBUG, "Assigning histogram entries for 0x%.16llX - 0x%.16llX", hist->lowpc, hist->highpc);
+    LogGated(LOG_DEBUG, "Assigning histogram entries for 0x%.16llX - 0x%.16llX", hist->lowpc, hist->highpc);
 
     uint32_t index;
-    bfd_vma bin_low, bin_high, sym_low, sym_high, overlap, hist_base_pc;
+    bfd_vma bin_low, bin_high, sym_low, sym_high, overlap, hist_base_pc, bin_addr;
 
     double time, total_time, credit;
 
     std::list<uint32_t> indexList;
+    const std::vector<FunctionEntry> &functions = m_symbols->GetFunctions();
 
     hist_base_pc = (hist->lowpc / sizeof(UNIT));
 
     // go through all bins present in this histogram record
     for (int i = 0; i < hist->num_bins; i++)
     {
+        // check for cancellation once in a while
+        if ((i % GMON_PROGRESS_BIN_STEP) == 0 && IsCancelled())
+            return false;
+
         if (hist->sample[i] <= 0)
             continue;
 
         // calculate low and high address
-        bin_low = hist_base_pc + (bfd_vma)(m_histogramScale * i);
-        bin_high = hist_base_pc + (bfd_vma)(m_histogramScale * (i + 1));
+        bin_low = hist_base_pc + (bfd_vma)(hist->scale * i);
+        bin_high = hist_base_pc + (bfd_vma)(hist->scale * (i + 1));
 
         time = hist->sample[i];
         total_time += time;
 
         // retrieve all functions, that are present in this bin
-        GetFunctionListByAddressRange(bin_low, bin_high, &indexList, true);
+        m_symbols->GetFunctionListByAddressRange(bin_low, bin_high, &indexList, true);
         for (std::list<uint32_t>::iterator itr = indexList.begin(); itr != indexList.end(); ++itr)
         {
             index = *itr;
 
             // calculate low and high address of this function
-            sym_low = m_functionTable[index].scaled_address;
-            sym_high = m_functionTable[index + 1].scaled_address;
+            sym_low = functions[index].scaled_address;
+            sym_high = m_symbols->GetFunctionEnd(index, true);
+
+            // function may end before the bin starts (excluded symbol follows it)
+            if (sym_high <= bin_low || sym_low >= bin_high)
+                continue;
 
             // calculate, how much of the bin is covered by this function
             // functions may overlap in bins
@@ -344,37 +302,62 @@ void GmonFile::AssignHistogramEntries(histogram* hist)
             if (overlap > 0)
             {
                 // this is the real "time credit" for this function call
-                credit = overlap * time / m_histogramScale;
+                credit = overlap * time / hist->scale;
 
-                // TODO: implement symbol table exclusion (i.e. builtins)
+                GetFlatProfileRecord(index)->timeTotal += credit;
 
-                m_flatProfile[index].timeTotal += credit;
+                // keep where within the function the samples were taken
+                bin_addr = nmax(bin_low * sizeof(UNIT), (bfd_vma)functions[index].address);
+                m_functionSamples.Add(index, (uint32_t)(bin_addr - functions[index].address), (uint32_t)(overlap * sizeof(UNIT)), credit);
             }
         }
     }
+
+    return true;
+}
+
+FlatProfileRecord* GmonFile::GetFlatProfileRecord(uint32_t functionIndex)
+{
+    std::unordered_map<uint32_t, uint32_t>::iterator itr = m_flatProfileSlots.find(functionIndex);
+    if (itr != m_flatProfileSlots.end())
+        return &m_flatProfile[itr->second];
+
+    // function gets its first sample or call - create record for it
+    m_flatProfileSlots[functionIndex] = (uint32_t)m_flatProfile.size();
+    m_flatProfile.resize(m_flatProfile.size() + 1);
+
+    FlatProfileRecord *fp = &m_flatProfile.back();
+
+    fp->functionId = functionIndex;
+    fp->callCount = 0;
+    fp->timeTotal = 0;
+    fp->timeTotalPct = 0.0f;
+
+    return fp;
 }
 
-void GmonFile::ProcessFlatProfile()
+bool GmonFile::ProcessFlatProfile()
 {
-    LogFunc(LOG_VERBOSE, "Processing flat profile");
+    LogGated(LOG_VERBOSE, "Processing flat profile");
 
-    m_flatProfile.resize(m_functionTable.size());
+    // flat profile is sparse - only functions with any samples or calls get their record
+    m_flatProfile.clear();
+    m_flatProfileSlots.clear();
+    m_functionSamples.Clear();
 
-    FlatProfileRecord *fp;
+    if (m_progress)
+        m_progress->histogramsTotal = m_histograms.size();
 
-    // prepare flat profile table, it will match function table at first stage of filling
-    for (int i = 0; i < m_functionTable.size(); i++)
+    for (size_t i = 0; i < m_histograms.size(); i++)
     {
-        fp = &m_flatProfile[i];
+        if (!AssignHistogramEntries(&m_histograms[i]))
+            return false;
 
-        fp->functionId = i;
-        fp->callCount = 0;
-        fp->timeTotal = 0;
-        fp->timeTotalPct = 0.0f;
+        if (m_progress)
+            m_progress->histogramsAttributed = i + 1;
     }
 
-    for (std::list<histogram*>::iterator itr = m_histograms.begin(); itr != m_histograms.end(); ++itr)
-        AssignHistogramEntries(*itr);
+    m_functionSamples.Finish();
 
     // scale profiling entries using profiling rate
     // profiling rate tells us how many measures are in one reported unit
@@ -385,256 +368,808 @@ void GmonFile::ProcessFlatProfile()
     uint32_t fi;
     callgraph_arc* cg;
 
+    // streamed arcs are merged to call counts and call graph at once
+    if (m_arcMemoryBudget && !MergeCallGraphArcs())
+        return false;
+
     // go through all callgraph data and collect call counts using so called "arcs"
-    for (std::list<callgraph_arc*>::iterator itr = m_callGraphArcs.begin(); itr != m_callGraphArcs.end(); ++itr)
+    for (size_t i = 0; i < m_callGraphArcs.size(); i++)
     {
-        cg = *itr;
+        if ((i % GMON_PROGRESS_RECORD_STEP) == 0 && IsCancelled())
+            return false;
+
+        cg = &m_callGraphArcs[i];
+
+        LogGated(LOG_DEBUG, "Read call graph arc, frompc %llu, selfpc %llu, count %lu", cg->frompc, cg->selfpc, cg->count);
 
         // also find function, add call count gathered by gprof
-        FunctionEntry *fe = GetFunctionByAddress(cg->selfpc, &fi);
+        const FunctionEntry *fe = m_symbols->GetFunctionByAddress(cg->selfpc, &fi);
         if (fe)
-            m_flatProfile[fi].callCount += cg->count;
+            GetFlatProfileRecord(fi)->callCount += cg->count;
     }
-}
 
-bool GmonFile::ReadVMA(bfd_vma *target)
-{
-    // TODO: platform dependent disambiguation
+    // keep records ordered by function ID, slot map is no longer needed
+    std::sort(m_flatProfile.begin(), m_flatProfile.end(), FlatProfileIdSortPredicate());
+    m_flatProfileSlots.clear();
 
-    if (fread(target, sizeof(bfd_vma), 1, m_file) != 1)
-        return false;
+    LogGated(LOG_VERBOSE, "Flat profile contains %llu of %llu functions",
+        (unsigned long long)m_flatProfile.size(), (unsigned long long)m_symbols->GetFunctions().size());
 
     return true;
 }
 
-bool GmonFile::Read32(int32_t *target)
+bool GmonFile::ReadFileData(const char* filename)
 {
-    if (fread(target, sizeof(int32_t), 1, m_file) != 1)
+    FILE* f = fopen(filename, "rb");
+    if (!f)
+    {
+        LogFunc(LOG_ERROR, "Couldn't find gmon file %s", filename);
         return false;
+    }
 
-    return true;
-}
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
 
-bool GmonFile::Read64(int64_t *target)
-{
-    if (fread(target, sizeof(int64_t), 1, m_file) != 1)
+    if (size < 0)
+    {
+        LogFunc(LOG_ERROR, "Couldn't determine size of gmon file %s", filename);
+        fclose(f);
         return false;
+    }
 
-    return true;
-}
+    // buffer capacity is kept between loads
+    m_data.resize((size_t)size);
 
-bool GmonFile::ReadBytes(void* target, int count)
-{
-    if (fread(target, sizeof(char), count, m_file) != count)
+    if (size > 0 && fread(&m_data[0], 1, (size_t)size, f) != (size_t)size)
+    {
+        LogFunc(LOG_ERROR, "Error while reading gmon file %s", filename);
+        fclose(f);
         return false;
+    }
+
+    fclose(f);
+
+    m_fileData = m_data.data();
+    m_fileSize = m_data.size();
 
     return true;
 }
 
-bool GmonFile::ReadString(std::string& target)
+bool GmonFile::MapFileData(const char* filename)
 {
-    char c;
-    target.clear();
+    int fd = open(filename, O_RDONLY);
+    if (fd < 0)
+    {
+        LogFunc(LOG_ERROR, "Couldn't find gmon file %s", filename);
+        return false;
+    }
 
-    // read until we reach zero
-    while (fread(&c, sizeof(char), 1, m_file) == 1)
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
     {
-        // when zero is found, return success
-        if (c == '\0')
-            return true;
+        LogFunc(LOG_ERROR, "Couldn't determine size of gmon file %s", filename);
+        close(fd);
+        return false;
+    }
+
+    void* map = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
 
-        // append character to string
-        target += c;
+    if (map == MAP_FAILED)
+    {
+        LogFunc(LOG_ERROR, "Could not map gmon file %s to memory", filename);
+        return false;
     }
 
-    return false;
+    // the file is walked from start to end
+    madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+
+    m_fileMapping = map;
+    m_fileData = (const uint8_t*)map;
+    m_fileSize = (uint64_t)st.st_size;
+
+    return true;
 }
 
-bool GmonFile::ReadHistogramRecord()
+void GmonFile::ReleaseFileData()
 {
-    histogram *n_record, *record;
+    if (m_fileMapping)
+        munmap(m_fileMapping, (size_t)m_fileSize);
 
-    unsigned int profrate;
-    char n_hist_dimension[15];
-    char n_hist_dimension_abbrev;
-    double n_hist_scale;
+    m_fileMapping = nullptr;
+    m_fileData = nullptr;
+    m_fileSize = 0;
+    m_data.clear();
+}
 
-    n_record = new histogram;
+void GmonFile::ReleaseFileRange(uint64_t low, uint64_t high)
+{
+    if (!m_fileMapping)
+        return;
 
-    // read header, field by field
-    if (!ReadVMA(&n_record->lowpc)
-        || !ReadVMA(&n_record->highpc)
-        || !Read32((int32_t*)&n_record->num_bins)
-        || !Read32((int32_t*)&profrate)
-        || !ReadBytes(n_hist_dimension, 15)
-        || !ReadBytes(&n_hist_dimension_abbrev, 1))
-    {
-        LogFunc(LOG_ERROR, "gmon file does not contain valid header");
-        return false;
-    }
+    // only whole pages could be dropped
+    uint64_t pageSize = (uint64_t)sysconf(_SC_PAGESIZE);
+    low = (low + pageSize - 1) / pageSize * pageSize;
+    high = high / pageSize * pageSize;
 
-    // count histogram scale
-    n_hist_scale = (double)((n_record->highpc - n_record->lowpc) / sizeof(UNIT)) / n_record->num_bins;
+    if (low < high)
+        madvise((uint8_t*)m_fileMapping + low, (size_t)(high - low), MADV_DONTNEED);
+}
 
-    // if we are reading first record, just store information
-    if (m_tagCount[GMON_TAG_TIME_HIST] == 0)
-    {
-        m_profRate = profrate;
-        m_histDimension = n_hist_dimension;
-        m_histDimensionAbbrev = n_hist_dimension_abbrev;
-        m_histogramScale = n_hist_scale;
-    }
-    else // otherwise check, if something went wrong about granularity or sampling dimension
+bool GmonFile::ScanRecords()
+{
+    LogGated(LOG_VERBOSE, "Indexing gmon file records");
+
+    gmon_cursor cur = { m_fileData + sizeof(gmon_header), m_fileData + m_fileSize };
+    gmon_record rec;
+    uint32_t num_bins, nblocks;
+    uint64_t arcCount = 0, blockCount = 0, histCount = 0, released = 0;
+    std::string tmp;
+
+    // only walk tags and record headers, the rest of records is just skipped
+    while (cur.pos < cur.end)
     {
-        // check dimension change
-        if (strncmp(m_histDimension.c_str(), n_hist_dimension, 15) != 0)
+        rec.tag = *cur.pos++;
+        rec.offset = cur.pos - m_fileData;
+        rec.item = 0;
+        rec.count = 0;
+
+        switch (rec.tag)
         {
-            LogFunc(LOG_ERROR, "Dimension unit changed between histogram records from %s to %s", m_histDimension.c_str(), n_hist_dimension);
-            return false;
+            case GMON_TAG_TIME_HIST:
+            {
+                if (!CheckHistogramHeader(cur, rec.offset, histCount == 0, num_bins))
+                    return false;
+
+                rec.length = GMON_HIST_HEADER_SIZE + (uint64_t)num_bins * sizeof(UNIT);
+                rec.item = histCount++;
+                break;
+            }
+            case GMON_TAG_CG_ARC:
+                rec.length = GMON_ARC_RECORD_SIZE;
+                rec.item = arcCount++;
+                rec.count = 1;
+                break;
+            case GMON_TAG_BB_COUNT:
+            {
+                gmon_cursor hdr = cur;
+                if (!Read32(hdr, (int32_t*)&nblocks))
+                {
+                    LogFunc(LOG_ERROR, "Truncated basic block record at offset %llu", (unsigned long long)rec.offset);
+                    return false;
+                }
+
+                if (m_fileVersion == 0)
+                {
+                    // old version contains variable-length strings, walk through them
+                    bool valid = ReadString(hdr, tmp);
+                    for (uint32_t i = 0; valid && i < nblocks; i++)
+                    {
+                        valid = Skip(hdr, sizeof(bfd_vma) * 2) && ReadString(hdr, tmp) && ReadString(hdr, tmp) && Skip(hdr, sizeof(int32_t));
+                    }
+
+                    if (!valid)
+                    {
+                        LogFunc(LOG_ERROR, "Truncated basic block record at offset %llu", (unsigned long long)rec.offset);
+                        return false;
+                    }
+
+                    rec.length = hdr.pos - cur.pos;
+                }
+                else
+                    rec.length = sizeof(int32_t) + (uint64_t)nblocks * sizeof(bfd_vma) * 2;
+
+                rec.item = blockCount;
+                rec.count = nblocks;
+                blockCount += nblocks;
+                break;
+            }
+            default:
+                LogFunc(LOG_ERROR, "File contains invalid tag %i at offset %llu", rec.tag, (unsigned long long)(rec.offset - 1));
+                return false;
         }
 
-        // check abbreviation change (although this should not change until the dimension changes as well)
-        if (m_histDimensionAbbrev != n_hist_dimension_abbrev)
+        // validate record against file size
+        if ((uint64_t)(cur.end - cur.pos) < rec.length)
         {
-            LogFunc(LOG_ERROR, "Dimension unit abbreviation changed between histogram records from %c to %c", m_histDimensionAbbrev, n_hist_dimension_abbrev);
+            LogFunc(LOG_ERROR, "Record at offset %llu exceeds file size", (unsigned long long)rec.offset);
             return false;
         }
 
-        // verify the scale didn't change
-        if (fabs(m_histogramScale - n_hist_scale) < 0.00001)
+        cur.pos += rec.length;
+
+        // arcs are streamed when memory-budgeted, they are the only records between the indexed ones
+        if (rec.tag == GMON_TAG_CG_ARC && m_arcMemoryBudget)
         {
-            LogFunc(LOG_ERROR, "Histogram scale changed between histogram records from %lf to %lf", m_histogramScale, n_hist_scale);
-            return false;
+            if (rec.offset + rec.length - released >= GMON_RELEASE_STEP)
+            {
+                ReleaseFileRange(released, rec.offset + rec.length);
+                released = rec.offset + rec.length;
+            }
+            continue;
         }
+
+        m_records.push_back(rec);
     }
 
-    histogram* existing;
+    // pre-size all storage, so records could be decoded independently
+    m_histograms.reserve(histCount);
+    if (!m_arcMemoryBudget)
+        m_callGraphArcs.resize(arcCount);
+    m_basicBlocks.resize(blockCount);
+
+    m_tagCount[GMON_TAG_CG_ARC] = arcCount;
+
+    LogGated(LOG_VERBOSE, "Indexed %llu records: %llu histograms, %llu arcs, %llu basic blocks", (unsigned long long)m_records.size(),
+        (unsigned long long)histCount, (unsigned long long)arcCount, (unsigned long long)blockCount);
+
+    return true;
+}
+
+bool GmonFile::CheckHistogramHeader(gmon_cursor cur, uint64_t offset, bool first, uint32_t &num_bins)
+{
+    bfd_vma lowpc, highpc;
+    uint32_t profrate;
+    char dimension[15];
+    char abbrev;
 
-    // find histogram, if exist for this part of program
-    if ((existing = FindHistogram(n_record->lowpc, n_record->highpc)) != nullptr)
+    if (!ReadVMA(cur, &lowpc)
+        || !ReadVMA(cur, &highpc)
+        || !Read32(cur, (int32_t*)&num_bins)
+        || !Read32(cur, (int32_t*)&profrate)
+        || !ReadBytes(cur, dimension, sizeof(dimension))
+        || !ReadBytes(cur, &abbrev, 1))
     {
-        record = existing;
-        delete n_record;
+        LogFunc(LOG_ERROR, "Truncated histogram record at offset %llu", (unsigned long long)offset);
+        return false;
     }
-    else // otherwise create new
+
+    if (num_bins == 0 || highpc <= lowpc)
     {
-        bfd_vma lowpc, highpc;
+        LogFunc(LOG_ERROR, "Histogram record at offset %llu covers empty address range", (unsigned long long)offset);
+        return false;
+    }
 
-        lowpc = n_record->lowpc;
-        highpc = n_record->highpc;
+    // dimension field is not terminated when it's full
+    std::string dim(dimension, strnlen(dimension, sizeof(dimension)));
 
-        ClipHistogramAddress(&lowpc, &highpc);
-        if (lowpc != highpc)
-        {
-            LogFunc(LOG_ERROR, "Found overlapping histogram records");
-            return false;
-        }
+    // if we are reading first record, just store information
+    if (first)
+    {
+        m_profRate = profrate;
+        m_histDimension = dim;
+        m_histDimensionAbbrev = abbrev;
+        return true;
+    }
 
-        m_histograms.push_back(n_record);
-        record = n_record;
+    // otherwise check, if something went wrong about sampling; differing scales are resampled later
+    if (profrate != m_profRate)
+    {
+        LogFunc(LOG_ERROR, "Sampling rate changed between histogram records from %u to %u", m_profRate, profrate);
+        return false;
+    }
 
-        record->sample = new int[record->num_bins];
-        memset(record->sample, 0, sizeof(int)*record->num_bins);
+    if (dim != m_histDimension)
+    {
+        LogFunc(LOG_ERROR, "Dimension unit changed between histogram records from %s to %s", m_histDimension.c_str(), dim.c_str());
+        return false;
     }
 
-    // read samples, add them to sample fields
-    for (uint32_t i = 0; i < record->num_bins; i++)
+    // check abbreviation change (although this should not change until the dimension changes as well)
+    if (abbrev != m_histDimensionAbbrev)
     {
-        UNIT count;
-        if (fread(&count[0], sizeof(count), 1, m_file) != 1)
+        LogFunc(LOG_ERROR, "Dimension unit abbreviation changed between histogram records from %c to %c", m_histDimensionAbbrev, abbrev);
+        return false;
+    }
+
+    return true;
+}
+
+bool GmonFile::DecodeRecords()
+{
+    size_t i;
+
+    // histogram records are merged into each other, so they are decoded serially (there's just a few of them)
+    for (i = 0; i < m_records.size(); i++)
+    {
+        if (m_records[i].tag == GMON_TAG_TIME_HIST)
         {
-            LogFunc(LOG_ERROR, "Error while reading samples from gmon file - unexpected end of file");
-            return false;
+            LogGated(LOG_DEBUG, "Reading histogram record");
+            if (!ReadHistogramRecord(m_records[i]))
+                return false;
         }
+    }
 
-        // TODO: endianity
+    // arc and basic block records have their place in storage assigned already, so they are decoded in parallel
+    size_t threadCount = 1;
+    if (m_callGraphArcs.size() + m_basicBlocks.size() >= GMON_PARALLEL_DECODE_THRESHOLD)
+        threadCount = nmax(std::thread::hardware_concurrency(), 1u);
 
-        // add to appropriate field
-        record->sample[i] += *((uint16_t*)&count);
+    std::atomic<bool> failed(false);
+    std::atomic<uint64_t> errorOffset(UINT64_MAX);
+    std::vector<std::thread> threads;
+    size_t chunk = (m_records.size() + threadCount - 1) / threadCount;
+
+    for (size_t t = 1; t < threadCount; t++)
+    {
+        size_t first = t * chunk;
+        size_t last = nmin(first + chunk, m_records.size());
+        if (first < last)
+            threads.push_back(std::thread(&GmonFile::DecodeRecordRange, this, first, last, &failed, &errorOffset));
+    }
+
+    // the first chunk is decoded by this thread
+    DecodeRecordRange(0, nmin(chunk, m_records.size()), &failed, &errorOffset);
+
+    for (i = 0; i < threads.size(); i++)
+        threads[i].join();
+
+    // workers do not log, the error is reported here
+    if (errorOffset != UINT64_MAX)
+        LogFunc(LOG_ERROR, "Malformed record at offset %llu", (unsigned long long)errorOffset.load());
+
+    if (failed)
+        return false;
+
+    // streamed arcs are decoded serially, as they are spilled in order
+    if (m_arcMemoryBudget && !StreamCallGraphArcs())
+        return false;
+
+    for (i = 0; i < m_records.size(); i++)
+    {
+        if (m_records[i].tag == GMON_TAG_BB_COUNT)
+            m_tagCount[GMON_TAG_BB_COUNT]++;
+    }
+
+    return true;
+}
+
+void GmonFile::DecodeRecordRange(size_t first, size_t last, std::atomic<bool>* failed, std::atomic<uint64_t>* errorOffset)
+{
+    uint64_t decodedBytes = 0;
+
+    for (size_t i = first; i < last; i++)
+    {
+        // report progress and check for cancellation once in a while, not to slow down decoding
+        if (((i - first) % GMON_PROGRESS_RECORD_STEP) == 0)
+        {
+            if (*failed || IsCancelled())
+            {
+                *failed = true;
+                return;
+            }
+
+            if (m_progress)
+            {
+                m_progress->bytesRead += decodedBytes;
+                decodedBytes = 0;
+            }
+        }
+
+        const gmon_record &rec = m_records[i];
+        decodedBytes += rec.length + 1;
+
+        bool valid = true;
+        if (rec.tag == GMON_TAG_CG_ARC)
+            valid = ReadCallGraphRecord(rec, m_callGraphArcs[rec.item]);
+        else if (rec.tag == GMON_TAG_BB_COUNT)
+            valid = ReadBasicBlockRecord(rec);
+
+        if (!valid)
+        {
+            // keep the lowest offset, when more threads fail
+            uint64_t offset = rec.offset - 1, current = *errorOffset;
+            while (offset < current && !errorOffset->compare_exchange_weak(current, offset))
+                ;
+
+            *failed = true;
+            return;
+        }
+    }
+}
+
+bool GmonFile::StreamCallGraphArcs()
+{
+    const uint64_t recordSize = 1 + GMON_ARC_RECORD_SIZE;
+
+    // half of the budget is for run buffer, the other half is shared by run readers when merging
+    uint64_t bufferEntries = nmax(m_arcMemoryBudget / 2 / sizeof(callsite_arc), (uint64_t)1);
+    m_arcSpill.Begin((size_t)nmin(bufferEntries, m_tagCount[GMON_TAG_CG_ARC]));
+
+    gmon_record rec = { GMON_TAG_CG_ARC, 0, GMON_ARC_RECORD_SIZE, 0, 1 };
+    callgraph_arc arc;
+    callsite_arc site;
+    uint64_t offset = sizeof(gmon_header), released = offset, reported = 0, count = 0;
+    uint64_t unresolvedCallers = 0, unresolvedCallees = 0;
+    const std::vector<FunctionEntry> &functions = m_symbols->GetFunctions();
+    size_t next = 0;
+
+    LogGated(LOG_VERBOSE, "Streaming call graph arcs, memory budget %llu bytes", (unsigned long long)m_arcMemoryBudget);
+
+    while (offset < m_fileSize)
+    {
+        // indexed records are skipped, everything between them are arcs
+        if (next < m_records.size() && m_records[next].offset == offset + 1)
+        {
+            offset += 1 + m_records[next].length;
+            next++;
+            continue;
+        }
+
+        if ((count % GMON_PROGRESS_RECORD_STEP) == 0)
+        {
+            if (IsCancelled())
+                return false;
+
+            // indexed records were reported when decoded, only arcs are reported here
+            if (m_progress)
+            {
+                m_progress->bytesRead += (count - reported) * recordSize;
+                reported = count;
+            }
+        }
+
+        if (offset - released >= GMON_RELEASE_STEP)
+        {
+            ReleaseFileRange(released, offset);
+            released = offset;
+        }
+
+        rec.offset = offset + 1;
+        if (!ReadCallGraphRecord(rec, arc))
+        {
+            LogFunc(LOG_ERROR, "Malformed call graph record at offset %llu", (unsigned long long)offset);
+            return false;
+        }
+        LogGated(LOG_DEBUG, "Read call graph arc, frompc %llu, selfpc %llu, count %lu", arc.frompc, arc.selfpc, arc.count);
+        offset += recordSize;
+        count++;
+
+        // resolve arc right away, only its call site is kept; calls from unknown callers still count to callee
+        if (!m_symbols->GetFunctionByAddress(arc.selfpc, &site.callee, false))
+        {
+            LogCounted(unresolvedCallees, LOG_DEBUG, "No function containing callee address %llu found, ignoring", arc.selfpc);
+            continue;
+        }
+
+        if (m_symbols->GetFunctionByAddress(arc.frompc, &site.caller, false))
+            site.offset = (uint32_t)(arc.frompc - functions[site.caller].address);
+        else
+        {
+            LogCounted(unresolvedCallers, LOG_DEBUG, "No function containing caller address %llu found, ignoring", arc.frompc);
+            site.caller = CALL_SITE_NO_CALLER;
+            site.offset = 0;
+        }
+
+        site.count = arc.count;
+
+        if (!m_arcSpill.Add(site))
+            return false;
+    }
+
+    ReleaseFileRange(released, m_fileSize);
+
+    ReportUnresolvedArcs(unresolvedCallers, unresolvedCallees);
+
+    if (m_progress)
+        m_progress->bytesRead += (count - reported) * recordSize;
+
+    LogGated(LOG_VERBOSE, "Streamed %llu call graph arcs, %llu runs spilled to temporary files", (unsigned long long)count,
+        (unsigned long long)m_arcSpill.GetRunCount());
+
+    return true;
+}
+
+void GmonFile::MergeBasicBlocks()
+{
+    size_t i, last;
+
+    if (m_basicBlocks.empty())
+        return;
+
+    std::sort(m_basicBlocks.begin(), m_basicBlocks.end(), [](const basic_block &a, const basic_block &b) {
+        return a.address < b.address;
+    });
+
+    // the same block may be reported more times (i.e. by more profiling runs)
+    last = 0;
+    for (i = 1; i < m_basicBlocks.size(); i++)
+    {
+        if (m_basicBlocks[i].address == m_basicBlocks[last].address)
+            m_basicBlocks[last].count += m_basicBlocks[i].count;
+        else
+            m_basicBlocks[++last] = m_basicBlocks[i];
+    }
+
+    m_basicBlocks.resize(last + 1);
+}
+
+bool GmonFile::Skip(gmon_cursor &cur, size_t count)
+{
+    if ((size_t)(cur.end - cur.pos) < count)
+        return false;
+
+    cur.pos += count;
+    return true;
+}
+
+bool GmonFile::ReadVMA(gmon_cursor &cur, bfd_vma *target)
+{
+    // TODO: platform dependent disambiguation
+
+    return ReadBytes(cur, target, sizeof(bfd_vma));
+}
+
+bool GmonFile::Read32(gmon_cursor &cur, int32_t *target)
+{
+    return ReadBytes(cur, target, sizeof(int32_t));
+}
+
+bool GmonFile::Read64(gmon_cursor &cur, int64_t *target)
+{
+    return ReadBytes(cur, target, sizeof(int64_t));
+}
+
+bool GmonFile::ReadBytes(gmon_cursor &cur, void* target, size_t count)
+{
+    if ((size_t)(cur.end - cur.pos) < count)
+        return false;
+
+    memcpy(target, cur.pos, count);
+    cur.pos += count;
+
+    return true;
+}
+
+bool GmonFile::ReadString(gmon_cursor &cur, std::string& target)
+{
+    // read until we reach zero
+    const uint8_t* zero = (const uint8_t*)memchr(cur.pos, 0, cur.end - cur.pos);
+    if (!zero)
+        return false;
+
+    target.assign((const char*)cur.pos, zero - cur.pos);
+    cur.pos = zero + 1;
+
+    return true;
+}
+
+bool GmonFile::ReadHistogramRecord(const gmon_record &rec)
+{
+    gmon_cursor cur = { m_fileData + rec.offset, m_fileData + rec.offset + rec.length };
+
+    histogram n_record, *record;
+
+    double n_hist_scale;
+
+    // read header; sampling rate and dimension were validated by ScanRecords already
+    if (!ReadVMA(cur, &n_record.lowpc)
+        || !ReadVMA(cur, &n_record.highpc)
+        || !Read32(cur, (int32_t*)&n_record.num_bins)
+        || !Skip(cur, sizeof(int32_t) + 15 + 1))
+    {
+        LogFunc(LOG_ERROR, "gmon file does not contain valid header");
+        return false;
+    }
+
+    // count histogram scale
+    n_hist_scale = (double)((n_record.highpc - n_record.lowpc) / sizeof(UNIT)) / n_record.num_bins;
+    n_record.scale = n_hist_scale;
+
+    // histogram of the same part of program with the same bins - samples are just added; the same range split
+    // into different bin count does not line up bin by bin, so it is resampled as any other overlapping histogram
+    record = FindHistogram(n_record.lowpc, n_record.highpc, n_record.num_bins);
+
+    // otherwise read samples to new histogram
+    if (!record)
+    {
+        TakePooledSamples(n_record.sample);
+        n_record.sample.assign(n_record.num_bins, 0);
+        record = &n_record;
+    }
+
+    // read samples, add them to sample fields
+    for (uint32_t i = 0; i < record->num_bins; i++)
+    {
+        UNIT count;
+        if (!ReadBytes(cur, &count[0], sizeof(count)))
+        {
+            LogFunc(LOG_ERROR, "Error while reading samples from gmon file - unexpected end of file");
+            m_samplePool.push_back(std::vector<int>());
+            m_samplePool.back().swap(n_record.sample);
+            return false;
+        }
+
+        // TODO: endianity
+
+        // add to appropriate field
+        record->sample[i] += *((uint16_t*)&count);
+    }
+
+    if (record == &n_record)
+    {
+        // find histograms covering any part of the same address range
+        std::vector<size_t> overlapping;
+        for (size_t i = 0; i < m_histograms.size(); i++)
+        {
+            if (nmax(m_histograms[i].lowpc, n_record.lowpc) < nmin(m_histograms[i].highpc, n_record.highpc))
+                overlapping.push_back(i);
+        }
+
+        if (overlapping.empty())
+        {
+            m_histograms.push_back(histogram());
+            std::swap(m_histograms.back(), n_record);
+        }
+        else
+            MergeHistograms(n_record, overlapping);
     }
 
     m_tagCount[GMON_TAG_TIME_HIST]++;
     return true;
 }
 
-void GmonFile::ClipHistogramAddress(bfd_vma *lowpc, bfd_vma *highpc)
+void GmonFile::TakePooledSamples(std::vector<int> &dst)
 {
-    bool found = false;
-
-    // if there are no other histogram records, just align two PCs and mark it successful
-    if (m_tagCount[GMON_TAG_TIME_HIST] == 0)
+    // reuse sample buffer from previous load, if any
+    if (!m_samplePool.empty())
     {
-        *highpc = *lowpc;
-        return;
+        dst.swap(m_samplePool.back());
+        m_samplePool.pop_back();
     }
+}
 
-    histogram* tmp;
+void GmonFile::ResampleHistogram(const histogram &src, histogram &dst)
+{
+    // bin edges are tracked as fixed-point positions in destination bins, clamped to the destination range
+    const uint64_t one = 1ULL << GMON_RESAMPLE_FRACTION_BITS;
+    const uint64_t limit = (uint64_t)dst.num_bins << GMON_RESAMPLE_FRACTION_BITS;
+
+    // source histogram never starts below destination one, it's a part of merged range
+    uint64_t base = (uint64_t)llround((double)(src.lowpc - dst.lowpc) / (dst.scale * sizeof(UNIT)) * one);
+    uint64_t step = (uint64_t)llround(src.scale / dst.scale * one);
+
+    // edges are computed from bin index, so the rounding error does not accumulate
+    uint64_t low = nmin(base, limit);
 
-    // go through all histogram records
-    for (std::list<histogram*>::iterator itr = m_histograms.begin(); itr != m_histograms.end(); ++itr)
+    // single pass over source bins; every source bin spans one or more destination bins
+    for (uint32_t i = 0; i < src.num_bins; i++)
     {
-        tmp = *itr;
+        uint64_t high = nmin(base + (uint64_t)(i + 1) * step, limit);
+        uint64_t count = (uint64_t)src.sample[i];
 
-        // compute common low and high PC
-        bfd_vma common_low, common_high;
-        common_low = nmax(tmp->lowpc, *lowpc);
-        common_high = nmin(tmp->highpc, *highpc);
+        if (count == 0)
+        {
+            low = high;
+            continue;
+        }
 
-        if (common_low < common_high)
+        // bin squeezed out at the border by rounding - keep its samples in the nearest bin
+        if (high <= low)
         {
-            if (found)
-            {
-                LogFunc(LOG_ERROR, "Overlapping histogram records!");
-                *highpc = *lowpc; // this is wrong, maybe
-                return;
-            }
+            dst.sample[nmin(low >> GMON_RESAMPLE_FRACTION_BITS, (uint64_t)dst.num_bins - 1)] += (int)count;
+            low = high;
+            continue;
+        }
 
-            found = true;
-            *lowpc = common_low;
-            *highpc = common_high;
+        // every destination bin gets its share of samples placed up to its edge minus what was placed before,
+        // so the last one takes the rounding remainder and no sample is lost
+        uint64_t placed = 0;
+        for (uint64_t pos = low; pos < high; )
+        {
+            uint64_t j = pos >> GMON_RESAMPLE_FRACTION_BITS;
+            uint64_t edge = nmin(high, (j + 1) << GMON_RESAMPLE_FRACTION_BITS);
+            uint64_t target = count * (edge - low) / (high - low);
+
+            dst.sample[j] += (int)(target - placed);
+            placed = target;
+            pos = edge;
         }
+
+        low = high;
     }
+}
 
-    if (!found)
-        *highpc = *lowpc;
+void GmonFile::MergeHistograms(histogram &record, const std::vector<size_t> &overlapping)
+{
+    histogram merged;
+
+    // union of all address ranges, at the coarsest scale of all merged histograms
+    merged.lowpc = record.lowpc;
+    merged.highpc = record.highpc;
+    double scale = record.scale;
+
+    for (size_t i = 0; i < overlapping.size(); i++)
+    {
+        const histogram &hist = m_histograms[overlapping[i]];
+        merged.lowpc = nmin(merged.lowpc, hist.lowpc);
+        merged.highpc = nmax(merged.highpc, hist.highpc);
+        scale = nmax(scale, hist.scale);
+    }
+
+    uint64_t units = (merged.highpc - merged.lowpc) / sizeof(UNIT);
+    merged.num_bins = (uint32_t)nmax((uint64_t)ceil((double)units / scale), (uint64_t)1);
+    merged.scale = (double)units / merged.num_bins;
+
+    LogGated(LOG_VERBOSE, "Merging %llu overlapping histograms to 0x%.16llX - 0x%.16llX, %u bins",
+        (unsigned long long)overlapping.size() + 1, merged.lowpc, merged.highpc, merged.num_bins);
+
+    TakePooledSamples(merged.sample);
+    merged.sample.assign(merged.num_bins, 0);
+
+    ResampleHistogram(record, merged);
+    for (size_t i = 0; i < overlapping.size(); i++)
+        ResampleHistogram(m_histograms[overlapping[i]], merged);
+
+    // return buffers of merged histograms to pool, remove them (from the back, indexes are ascending)
+    m_samplePool.push_back(std::vector<int>());
+    m_samplePool.back().swap(record.sample);
+
+    for (size_t i = overlapping.size(); i-- > 0; )
+    {
+        m_samplePool.push_back(std::vector<int>());
+        m_samplePool.back().swap(m_histograms[overlapping[i]].sample);
+        m_histograms.erase(m_histograms.begin() + overlapping[i]);
+    }
+
+    m_histograms.push_back(histogram());
+    std::swap(m_histograms.back(), merged);
 }
 
-histogram* GmonFile::FindHistogram(bfd_vma lowpc, bfd_vma highpc)
+histogram* GmonFile::FindHistogram(bfd_vma lowpc, bfd_vma highpc, uint32_t num_bins)
 {
     // go through all histogram records, and find matching aligned histogram
-    for (std::list<histogram*>::iterator itr = m_histograms.begin(); itr != m_histograms.end(); ++itr)
+    for (size_t i = 0; i < m_histograms.size(); i++)
     {
-        if ((*itr)->lowpc == lowpc && (*itr)->highpc == highpc)
-            return *itr;
+        if (m_histograms[i].lowpc == lowpc && m_histograms[i].highpc == highpc && m_histograms[i].num_bins == num_bins)
+            return &m_histograms[i];
     }
 
     return nullptr;
 }
 
-void GmonFile::ProcessCallGraph()
+bool GmonFile::ProcessCallGraph()
 {
-    LogFunc(LOG_VERBOSE, "Processing call graph");
+    LogGated(LOG_VERBOSE, "Processing call graph");
+
+    // streamed arcs were merged together with call counts already
+    if (m_arcMemoryBudget)
+        return true;
 
     uint32_t srcIndex, dstIndex;
     callgraph_arc* arc;
+    uint64_t unresolvedCallers = 0, unresolvedCallees = 0;
+    const std::vector<FunctionEntry> &functions = m_symbols->GetFunctions();
 
     m_callGraph.clear();
+    m_callSites.Clear();
+
+    if (m_progress)
+        m_progress->arcsTotal = m_callGraphArcs.size();
 
     // go through all callgraph arc collected from gmon file and assign function entry (index) to them
 
-    for (std::list<callgraph_arc*>::iterator itr = m_callGraphArcs.begin(); itr != m_callGraphArcs.end(); itr++)
+    for (size_t i = 0; i < m_callGraphArcs.size(); i++)
     {
-        arc = *itr;
+        if (m_progress && (i % GMON_PROGRESS_RECORD_STEP) == 0)
+        {
+            m_progress->arcsProcessed = i;
+            if (IsCancelled())
+                return false;
+        }
 
-        if (!GetFunctionByAddress(arc->frompc, &srcIndex, false))
+        arc = &m_callGraphArcs[i];
+
+        if (!m_symbols->GetFunctionByAddress(arc->frompc, &srcIndex, false))
         {
-            LogFunc(LOG_WARNING, "No function containing caller address %llu found, ignoring", arc->frompc);
+            LogCounted(unresolvedCallers, LOG_DEBUG, "No function containing caller address %llu found, ignoring", arc->frompc);
             continue;
         }
 
-        if (!GetFunctionByAddress(arc->selfpc, &dstIndex, false))
+        if (!m_symbols->GetFunctionByAddress(arc->selfpc, &dstIndex, false))
         {
-            LogFunc(LOG_WARNING, "No function containing callee address %llu found, ignoring", arc->selfpc);
+            LogCounted(unresolvedCallees, LOG_DEBUG, "No function containing callee address %llu found, ignoring", arc->selfpc);
             continue;
         }
 
@@ -649,49 +1184,113 @@ void GmonFile::ProcessCallGraph()
         }
 
         m_callGraph[srcIndex][dstIndex] += arc->count;
-    }
+
+        // also keep the exact call site, as an offset within caller function
+        m_callSites.Add({ srcIndex, (uint32_t)(arc->frompc - functions[srcIndex].address), dstIndex, arc->count });
+    }
+
+    if (m_progress)
+        m_progress->arcsProcessed = m_callGraphArcs.size();
+
+    ReportUnresolvedArcs(unresolvedCallers, unresolvedCallees);
+
+    m_callSites.Build();
+
+    return true;
 }
 
-bool GmonFile::ReadCallGraphRecord()
-{
-    callgraph_arc *cg = new callgraph_arc();
+void GmonFile::ReportUnresolvedArcs(uint64_t callers, uint64_t callees)
+{
+    // single summary instead of warning per arc; the first few addresses are logged at debug level
+    if (callers > 0)
+        LogGated(LOG_WARNING, "%llu call graph arcs ignored, no function containing caller address found", (unsigned long long)callers);
+    if (callees > 0)
+        LogGated(LOG_WARNING, "%llu call graph arcs ignored, no function containing callee address found", (unsigned long long)callees);
+}
 
-    // read call graph record - source PC, self PC and count
-    if (!ReadVMA(&cg->frompc)
-        || !ReadVMA(&cg->selfpc)
-        || !Read32((int32_t*)&cg->count))
-    {
-        delete cg;
-        LogFunc(LOG_ERROR, "Unexpected end of file while reading callgraph record");
+bool GmonFile::MergeCallGraphArcs()
+{
+    callsite_arc site;
+    uint64_t count = 0;
+
+    m_callGraph.clear();
+
+    // merged call sites come sorted and every one of them just once, so they are appended to spilled table directly,
+    // keeping memory bounded by the count of caller-callee pairs in call graph map, not by the count of call sites
+    if (!m_arcSpill.StartMerge() || !m_callSites.BeginSpilled())
         return false;
+
+    if (m_progress)
+        m_progress->arcsTotal = m_tagCount[GMON_TAG_CG_ARC];
+
+    while (m_arcSpill.Next(site))
+    {
+        if ((++count % GMON_PROGRESS_RECORD_STEP) == 0 && IsCancelled())
+            return false;
+
+        GetFlatProfileRecord(site.callee)->callCount += site.count;
+
+        if (site.caller == CALL_SITE_NO_CALLER)
+            continue;
+
+        m_callGraph[site.caller][site.callee] += site.count;
+
+        if (!m_callSites.AppendSpilled(site))
+            return false;
     }
 
-    LogFunc(LOG_DEBUG, "Read call graph block, frompc %llu, selfpc %llu, count %lu", cg->frompc, cg->selfpc, cg->count);
-
-    // just store recorded data for later reuse
-    m_callGraphArcs.push_back(cg);
+    if (m_progress)
+        m_progress->arcsProcessed = m_tagCount[GMON_TAG_CG_ARC];
+
+    bool result = !m_arcSpill.HasFailed() && m_callSites.FinishSpilled();
+
+    // drop temporary files
+    m_arcSpill.Clear();
+
+    return result;
+}
+
+void GmonFile::GetCallSitesByCaller(uint32_t caller, std::vector<callsite_arc> &dst)
+{
+    m_callSites.GetByCaller(caller, dst);
+}
+
+void GmonFile::GetCallSitesByCallee(uint32_t callee, std::vector<callsite_arc> &dst)
+{
+    m_callSites.GetByCallee(callee, dst);
+}
+
+bool GmonFile::ReadCallGraphRecord(const gmon_record &rec, callgraph_arc &cg)
+{
+    gmon_cursor cur = { m_fileData + rec.offset, m_fileData + rec.offset + rec.length };
+
+    cg.count = 0;
+
+    // read call graph record - source PC, self PC and count
+    if (!ReadVMA(cur, &cg.frompc)
+        || !ReadVMA(cur, &cg.selfpc)
+        || !Read32(cur, (int32_t*)&cg.count))
+        return false;
 
-    m_tagCount[GMON_TAG_CG_ARC]++;
     return true;
 }
 
-bool GmonFile::ReadBasicBlockRecord()
+bool GmonFile::ReadBasicBlockRecord(const gmon_record &rec)
 {
+    gmon_cursor cur = { m_fileData + rec.offset, m_fileData + rec.offset + rec.length };
+
     uint32_t nblocks;
     std::string tmp;
     bfd_vma addr, ncalls;
     uint32_t line_num;
 
     // read block count
-    if (!Read32((int32_t*)&nblocks))
-    {
-        LogFunc(LOG_ERROR, "Unexpected end of file while reading basic block record");
+    if (!Read32(cur, (int32_t*)&nblocks))
         return false;
-    }
 
     // old version contained status string
     if (m_fileVersion == 0)
-        ReadString(tmp);
+        ReadString(cur, tmp);
 
     // read all available blocks
     for (uint32_t i = 0; i < nblocks; i++)
@@ -699,53 +1298,280 @@ bool GmonFile::ReadBasicBlockRecord()
         // old version contained lots of fields we don't care about now
         if (m_fileVersion == 0)
         {
-            if (!ReadVMA(&ncalls)
-                || !ReadVMA(&addr)
-                || !ReadString(tmp) // deprecated
-                || !ReadString(tmp) // deprecated
-                || !Read32((int32_t*)&line_num))
-            {
-                LogFunc(LOG_ERROR, "Unexpected end of file while reading basic block record data");
+            if (!ReadVMA(cur, &ncalls)
+                || !ReadVMA(cur, &addr)
+                || !ReadString(cur, tmp) // deprecated
+                || !ReadString(cur, tmp) // deprecated
+                || !Read32(cur, (int32_t*)&line_num))
                 return false;
-            }
         }
         else
         {
-            if (!ReadVMA(&addr)
-                || !ReadVMA(&ncalls))
-            {
-                LogFunc(LOG_ERROR, "Unexpected end of file while reading basic block record data");
+            if (!ReadVMA(cur, &addr)
+                || !ReadVMA(cur, &ncalls))
                 return false;
-            }
         }
 
-        // TODO: store data and deduce some useful information
+        // store block execution count for later line attribution
+        m_basicBlocks[rec.item + i].address = addr;
+        m_basicBlocks[rec.item + i].count = (uint64_t)ncalls;
     }
 
-    m_tagCount[GMON_TAG_BB_COUNT]++;
     return true;
 }
 
 void GmonFile::FillFunctionTable(std::vector<FunctionEntry> &dst)
 {
-    LogFunc(LOG_VERBOSE, "Passing function table from input module to core");
+    LogGated(LOG_VERBOSE, "Passing function table from input module to core");
 
-    dst.assign(m_functionTable.begin(), m_functionTable.end());
+    dst.assign(m_symbols->GetFunctions().begin(), m_symbols->GetFunctions().end());
 }
 
 void GmonFile::FillFlatProfileTable(std::vector<FlatProfileRecord> &dst)
 {
-    LogFunc(LOG_VERBOSE, "Passing flat profile table from input module to core");
+    LogGated(LOG_VERBOSE, "Passing flat profile table from input module to core");
+
+    // expand sparse profile to match function table
+    dst.resize(m_symbols->GetFunctions().size());
+    for (uint32_t i = 0; i < dst.size(); i++)
+    {
+        dst[i].functionId = i;
+        dst[i].callCount = 0;
+        dst[i].timeTotal = 0;
+        dst[i].timeTotalPct = 0.0f;
+    }
+
+    for (size_t i = 0; i < m_flatProfile.size(); i++)
+        dst[m_flatProfile[i].functionId] = m_flatProfile[i];
+}
+
+void GmonFile::FillSparseFlatProfileTable(std::vector<FlatProfileRecord> &dst)
+{
+    LogGated(LOG_VERBOSE, "Passing sparse flat profile table from input module to core");
 
     dst.assign(m_flatProfile.begin(), m_flatProfile.end());
 }
 
+void GmonFile::FillTopFlatProfileTable(std::vector<FlatProfileRecord> &dst, uint32_t count)
+{
+    LogGated(LOG_VERBOSE, "Passing top %u flat profile records from input module to core", count);
+
+    dst.clear();
+    if (count == 0)
+        return;
+
+    dst.reserve(nmin((size_t)count, m_flatProfile.size()));
+
+    // keep bounded min-heap of hottest functions; the top of heap is the coldest of them. The heap could not be
+    // kept during attribution - a function evicted early may still gain samples from later bins or calls from arcs
+    FlatProfileHotnessPredicate hotter;
+    for (size_t i = 0; i < m_flatProfile.size(); i++)
+    {
+        if (dst.size() < count)
+        {
+            dst.push_back(m_flatProfile[i]);
+            std::push_heap(dst.begin(), dst.end(), hotter);
+        }
+        else if (hotter(m_flatProfile[i], dst.front()))
+        {
+            std::pop_heap(dst.begin(), dst.end(), hotter);
+            dst.back() = m_flatProfile[i];
+            std::push_heap(dst.begin(), dst.end(), hotter);
+        }
+    }
+
+    // hottest first
+    std::sort_heap(dst.begin(), dst.end(), hotter);
+}
+
 void GmonFile::FillCallGraphMap(CallGraphMap &dst)
 {
-    LogFunc(LOG_VERBOSE, "Passing call graph from input module to core");
+    LogGated(LOG_VERBOSE, "Passing call graph from input module to core");
 
     // perform deep copy
     for (CallGraphMap::iterator itr = m_callGraph.begin(); itr != m_callGraph.end(); ++itr)
         for (std::map<uint32_t, uint64_t>::iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
             dst[itr->first][sitr->first] = sitr->second;
 }
+
+void GmonFile::GetHeaviestCallChains(uint32_t function, CallChainDirection direction, uint32_t count, std::vector<call_chain> &dst)
+{
+    if (!m_callChains.IsBuilt())
+        m_callChains.Build((uint32_t)m_symbols->GetFunctions().size(), m_flatProfile, m_callGraph);
+
+    m_callChains.Query(function, direction, count, dst);
+}
+
+void GmonFile::GetHottestOffsets(uint32_t function, uint32_t count, std::vector<function_sample> &dst) const
+{
+    m_functionSamples.GetHottest(function, count, dst);
+}
+
+void GmonFile::FillClassTable(std::vector<ClassEntry> &dst)
+{
+    LogGated(LOG_VERBOSE, "Passing class table from input module to core");
+
+    const std::vector<ClassEntry> &classes = m_symbols->GetClassTable().GetClasses();
+    dst.insert(dst.end(), classes.begin(), classes.end());
+}
+
+void GmonFile::FillClassProfileTable(std::vector<class_profile_record> &dst)
+{
+    const std::vector<class_profile_record> &profile = m_classProfile;
+    dst.insert(dst.end(), profile.begin(), profile.end());
+}
+
+bool GmonFile::WriteFunctionOrder(const char* hotFilename, const char* coldFilename, FunctionOrderFormat format, uint32_t maxClusterSize)
+{
+    FunctionOrder order;
+
+    order.Build(m_symbols->GetFunctions(), m_flatProfile, m_callGraph, maxClusterSize);
+
+    return order.Write(m_binaryFilename.c_str(), m_symbols->GetFunctions(), hotFilename, coldFilename, format);
+}
+
+bool GmonFile::ExportPprof(const char* filename) const
+{
+    PprofExporter exporter;
+
+    return exporter.Export(filename, m_binaryFilename.c_str(), m_symbols->GetFunctions(), m_flatProfile, m_callGraph);
+}
+
+bool GmonFile::WriteGmon(const char* filename) const
+{
+    GmonWriter writer;
+
+    return writer.Write(filename, m_histograms, m_profRate, m_histDimension, m_histDimensionAbbrev, m_symbols->GetFunctions(), m_callSites, m_basicBlocks);
+}
+
+bool GmonFile::BuildLineProfile()
+{
+    LogGated(LOG_VERBOSE, "Building line profile");
+
+    m_lineProfile.clear();
+
+    if (!m_lineTable.Load(m_binaryFilename.c_str()))
+        return false;
+
+    const std::vector<line_row> &rows = m_lineTable.GetRows();
+    if (rows.empty())
+        return true;
+
+    std::unordered_map<uint64_t, uint32_t> lineSlots;
+
+    // retrieves profile record of given row's line, creates it when needed
+    auto lineRecord = [&](const line_row &row) -> line_profile_record& {
+        uint64_t key = (((uint64_t)row.file) << 32) | row.line;
+        std::unordered_map<uint64_t, uint32_t>::iterator itr = lineSlots.find(key);
+        if (itr != lineSlots.end())
+            return m_lineProfile[itr->second];
+
+        lineSlots[key] = (uint32_t)m_lineProfile.size();
+        m_lineProfile.push_back({ row.file, row.line, 0.0, 0 });
+        return m_lineProfile.back();
+    };
+
+    // sweep bins and rows (both sorted by address) at once, the same way as function attribution does
+    for (size_t h = 0; h < m_histograms.size(); h++)
+    {
+        const histogram &hist = m_histograms[h];
+        double binBytes = hist.scale * sizeof(UNIT);
+        int64_t first = m_lineTable.FindRow(hist.lowpc);
+        size_t r = first < 0 ? 0 : (size_t)first;
+
+        for (uint32_t i = 0; i < hist.num_bins; i++)
+        {
+            if (hist.sample[i] <= 0)
+                continue;
+
+            double binLow = (double)hist.lowpc + binBytes * i;
+            double binHigh = binLow + binBytes;
+
+            // skip rows ending before this bin
+            while (r + 1 < rows.size() && (double)rows[r + 1].address <= binLow)
+                r++;
+
+            for (size_t k = r; k + 1 < rows.size() && (double)rows[k].address < binHigh; k++)
+            {
+                if (rows[k].line == DWARF_LINE_END_SEQUENCE)
+                    continue;
+
+                double overlap = nmin(binHigh, (double)rows[k + 1].address) - nmax(binLow, (double)rows[k].address);
+                if (overlap > 0)
+                    lineRecord(rows[k]).timeTotal += overlap * hist.sample[i] / binBytes;
+            }
+        }
+    }
+
+    // scale by profiling rate, so the lines use the same unit as flat profile
+    double profRate = (double)m_profRate;
+    for (size_t i = 0; i < m_lineProfile.size() && profRate > 0.0; i++)
+        m_lineProfile[i].timeTotal /= profRate;
+
+    // attribute basic block counts
+    for (size_t i = 0; i < m_basicBlocks.size(); i++)
+    {
+        int64_t row = m_lineTable.FindRow(m_basicBlocks[i].address);
+        if (row >= 0)
+            lineRecord(rows[row]).blockCount += m_basicBlocks[i].count;
+    }
+
+    // the hottest lines first
+    std::sort(m_lineProfile.begin(), m_lineProfile.end(), [](const line_profile_record &a, const line_profile_record &b) {
+        if (a.timeTotal != b.timeTotal)
+            return a.timeTotal > b.timeTotal;
+        return a.blockCount > b.blockCount;
+    });
+
+    LogGated(LOG_VERBOSE, "Line profile contains %llu lines", (unsigned long long)m_lineProfile.size());
+
+    return true;
+}
+
+void GmonFile::FillLineProfileTable(std::vector<line_profile_record> &dst)
+{
+    dst.assign(m_lineProfile.begin(), m_lineProfile.end());
+}
+
+const char* GmonFile::GetSourceFileName(uint32_t file) const
+{
+    return m_lineTable.GetFileName(file);
+}
+
+bool GmonFile::GetHeatMap(uint64_t lowpc, uint64_t highpc, uint32_t binCount, std::vector<double> &dst) const
+{
+    return m_histogramPyramid.Query(lowpc, highpc, binCount, dst);
+}
+
+double GmonFile::GetRangeSamples(uint64_t lowpc, uint64_t highpc) const
+{
+    return m_sampleIndex.Query(lowpc, highpc);
+}
+
+double GmonFile::GetRangeTime(uint64_t lowpc, uint64_t highpc) const
+{
+    if (m_profRate == 0)
+        return 0.0;
+
+    return m_sampleIndex.Query(lowpc, highpc) / (double)m_profRate;
+}
+
+size_t GmonFile::GetFunctionCount() const
+{
+    return m_symbols->GetFunctions().size();
+}
+
+const binary_identity& GmonFile::GetBinaryIdentity() const
+{
+    return m_binaryIdentity;
+}
+
+const std::vector<FlatProfileRecord>& GmonFile::GetFlatProfile() const
+{
+    return m_flatProfile;
+}
+
+const CallGraphMap& GmonFile::GetCallGraph() const
+{
+    return m_callGraph;
+}
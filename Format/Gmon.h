@@ -24,12 +24,45 @@
 #include "UnitIdentifiers.h"
 #include "FlatProfileStructs.h"
 #include "CallGraphStructs.h"
+#include "HistogramPyramid.h"
+#include "SampleIndex.h"
+#include "FunctionOrder.h"
+#include "LoadProgress.h"
+#include "DwarfLines.h"
+#include "ClassTable.h"
+#include "SymbolFilter.h"
+#include "SymbolTable.h"
+#include "CallChains.h"
+#include "ArcSpill.h"
+#include "CallSiteTable.h"
+#include "FunctionSamples.h"
+
+#include <unordered_map>
 
 // gmon.out file magic cookie
 #define	GMON_MAGIC "gmon"
 // gmon.out highest supported file version
 #define GMON_VERSION 1
 
+// size of histogram record header (low and high PC, bin count, profiling rate, dimension and its abbreviation)
+#define GMON_HIST_HEADER_SIZE (2 * sizeof(bfd_vma) + 2 * sizeof(int32_t) + 15 + 1)
+// size of call graph arc record (caller and callee PC, count)
+#define GMON_ARC_RECORD_SIZE (2 * sizeof(bfd_vma) + sizeof(int32_t))
+// count of arcs and basic blocks, from which the records are decoded in parallel
+#define GMON_PARALLEL_DECODE_THRESHOLD 65536
+// fractional bits of fixed-point positions used when resampling histogram bins
+#define GMON_RESAMPLE_FRACTION_BITS 24
+
+// count of records (arcs, symbols) processed between progress updates and cancellation checks
+#define GMON_PROGRESS_RECORD_STEP 4096
+// count of histogram bins processed between cancellation checks
+#define GMON_PROGRESS_BIN_STEP 65536
+// count of bytes of mapped gmon file walked between releases of its pages (memory-budgeted loads)
+#define GMON_RELEASE_STEP (16 * 1024 * 1024)
+
+// caller of streamed arc, whose caller address couldn't be resolved (the call still counts to callee)
+#define CALL_SITE_NO_CALLER ((uint32_t)-1)
+
 // gmon.out file header
 struct gmon_header
 {
@@ -59,7 +92,31 @@ struct histogram
     bfd_vma lowpc;
     bfd_vma highpc;
     uint32_t num_bins;
-    int *sample;
+    // address units (see UNIT) covered by one bin
+    double scale;
+    std::vector<int> sample;
+};
+
+// sorts flat profile records by function ID
+struct FlatProfileIdSortPredicate
+{
+    bool operator()(const FlatProfileRecord &a, const FlatProfileRecord &b) const
+    {
+        return a.functionId < b.functionId;
+    }
+};
+
+// orders flat profile records from the hottest (most time, then most calls) to the coldest
+struct FlatProfileHotnessPredicate
+{
+    bool operator()(const FlatProfileRecord &a, const FlatProfileRecord &b) const
+    {
+        if (a.timeTotal != b.timeTotal)
+            return a.timeTotal > b.timeTotal;
+        if (a.callCount != b.callCount)
+            return a.callCount > b.callCount;
+        return a.functionId < b.functionId;
+    }
 };
 
 struct callgraph_arc
@@ -69,67 +126,208 @@ struct callgraph_arc
     uint64_t count;
 };
 
+// position within in-memory gmon file data
+struct gmon_cursor
+{
+    const uint8_t* pos;
+    const uint8_t* end;
+};
+
+// record located by pre-scan of gmon file
+struct gmon_record
+{
+    // record tag
+    uint8_t tag;
+    // offset of record data (right after tag)
+    uint64_t offset;
+    // length of record data
+    uint64_t length;
+    // index of first item (histogram, arc, basic block) of this record in preallocated storage
+    uint64_t item;
+    // count of items in this record
+    uint32_t count;
+};
+
+// basic block execution count record
+struct basic_block
+{
+    bfd_vma address;
+    uint64_t count;
+};
+
 // gmon.out file wrapper class
 class GmonFile
 {
     public:
-        // public factory method loading data from supplied file
-        static GmonFile* Load(const char* filename, const char* binaryFilename);
+        // public factory method loading data from supplied file; progress (if supplied) is updated during load,
+        // symbols rejected by filter (if supplied) are not loaded at all; non-zero arc memory budget (in bytes) makes
+        // call graph arcs to be streamed from mapped file and spilled to temporary files when exceeding the budget
+        static GmonFile* Load(const char* filename, const char* binaryFilename, GmonLoadProgress* progress = nullptr,
+            const SymbolFilter* filter = nullptr, uint64_t arcMemoryBudget = 0);
+        ~GmonFile();
+
+        // loads data from supplied file again, reusing storage allocated by previous loads
+        bool Reload(const char* filename, const char* binaryFilename, GmonLoadProgress* progress = nullptr,
+            const SymbolFilter* filter = nullptr, uint64_t arcMemoryBudget = 0);
+        // drops all loaded data, but keeps allocated storage for next load
+        void Reset();
 
         // fills function table with loaded symbols
         void FillFunctionTable(std::vector<FunctionEntry> &dst);
-        // fills flat profile with analyzed data
+        // fills flat profile with analyzed data, one record for every function
         void FillFlatProfileTable(std::vector<FlatProfileRecord> &dst);
+        // fills flat profile with records of functions, that have any samples or calls
+        void FillSparseFlatProfileTable(std::vector<FlatProfileRecord> &dst);
+        // fills flat profile with at most count hottest functions, the hottest first; selected from finished
+        // sparse profile, the count is known only at query time and records still grow during attribution
+        void FillTopFlatProfileTable(std::vector<FlatProfileRecord> &dst, uint32_t count);
         // fills call graph map with gathered data
         void FillCallGraphMap(CallGraphMap &dst);
+        // fills class table built from demangled function names
+        void FillClassTable(std::vector<ClassEntry> &dst);
+        // fills class profile (aggregated self time and calls of class functions), indexed by class ID
+        void FillClassProfileTable(std::vector<class_profile_record> &dst);
+
+        // retrieves all call sites within given caller function, ordered by offset
+        void GetCallSitesByCaller(uint32_t caller, std::vector<callsite_arc> &dst);
+        // retrieves all call sites calling given callee function
+        void GetCallSitesByCallee(uint32_t callee, std::vector<callsite_arc> &dst);
+        // retrieves at most count heaviest acyclic call chains leading to (or from) given function
+        void GetHeaviestCallChains(uint32_t function, CallChainDirection direction, uint32_t count, std::vector<call_chain> &dst);
+        // retrieves at most count address ranges within given function with the most samples, the hottest first
+        void GetHottestOffsets(uint32_t function, uint32_t count, std::vector<function_sample> &dst) const;
+
+        // fills dst with binCount sample counts evenly covering <lowpc; highpc) address range
+        bool GetHeatMap(uint64_t lowpc, uint64_t highpc, uint32_t binCount, std::vector<double> &dst) const;
+        // retrieves count of samples within <lowpc; highpc) address range in constant time
+        double GetRangeSamples(uint64_t lowpc, uint64_t highpc) const;
+        // retrieves time spent within <lowpc; highpc) address range
+        double GetRangeTime(uint64_t lowpc, uint64_t highpc) const;
+
+        // writes linker function order file (hot functions clustered by call chains) and cold function list
+        bool WriteFunctionOrder(const char* hotFilename, const char* coldFilename, FunctionOrderFormat format = FOF_SYMBOLS,
+            uint32_t maxClusterSize = FUNCTION_ORDER_DEFAULT_CLUSTER_SIZE);
+        // exports processed profile to pprof file
+        bool ExportPprof(const char* filename) const;
+        // writes loaded (merged, filtered) profile back to gmon.out file; this is not a byte-exact copy of the input:
+        // overlapping histograms are written merged, repeated arcs are written once with summed count, and arcs
+        // with caller or callee not resolved to any (or excluded by symbol filter) function are not written at all
+        bool WriteGmon(const char* filename) const;
+
+        // attributes histogram bins and basic block counts to source lines using .debug_line of the binary
+        bool BuildLineProfile();
+        // fills line profile built by BuildLineProfile, the hottest lines first
+        void FillLineProfileTable(std::vector<line_profile_record> &dst);
+        // retrieves source file name of line profile record
+        const char* GetSourceFileName(uint32_t file) const;
+
+        // retrieves number of loaded symbols
+        size_t GetFunctionCount() const;
+        // retrieves identity of binary used for symbol resolving
+        const binary_identity& GetBinaryIdentity() const;
+        // retrieves processed sparse flat profile without copying it (sorted by function ID)
+        const std::vector<FlatProfileRecord>& GetFlatProfile() const;
+        // retrieves processed call graph map without copying it
+        const CallGraphMap& GetCallGraph() const;
 
     private:
         // private constructor - use public factory method to instantiate this class
         GmonFile();
 
-        // resolve symbols from executable file using builtin tools (nm, winnm, ..)
-        void ResolveSymbols(const char* binaryFilename);
+        // loads file contents and processes them
+        bool LoadContents(const char* filename, const char* binaryFilename);
+        // was cancellation of current load requested?
+        bool IsCancelled() const;
+        // reports current load stage
+        void SetStage(GmonLoadStage stage);
 
-        // creates flat profile
-        void ProcessFlatProfile();
-        // creates call graph map
-        void ProcessCallGraph();
+        // creates flat profile; returns false when cancelled
+        bool ProcessFlatProfile();
+        // creates call graph map; returns false when cancelled
+        bool ProcessCallGraph();
+        // logs summary of call graph arcs ignored due to unresolved caller or callee
+        static void ReportUnresolvedArcs(uint64_t callers, uint64_t callees);
+        // merges streamed call sites to call counts, call graph map and call site table; returns false when cancelled
+        bool MergeCallGraphArcs();
+
+        // contents of source file, kept only while loading
+        std::vector<uint8_t> m_data;
+        // source file contents - either read to buffer above, or mapped to memory
+        const uint8_t* m_fileData;
+        uint64_t m_fileSize;
+        // mapping of source file, null when the file was read to buffer
+        void* m_fileMapping;
+        // index of records in source file; streamed arcs are not indexed
+        std::vector<gmon_record> m_records;
 
-        // source file
-        FILE* m_file;
+        // reads whole source file to memory
+        bool ReadFileData(const char* filename);
+        // maps source file to memory, so its pages could be dropped once processed
+        bool MapFileData(const char* filename);
+        // drops source file contents (buffer or mapping)
+        void ReleaseFileData();
+        // drops pages of mapped source file within <low; high) byte range; they are read again when accessed
+        void ReleaseFileRange(uint64_t low, uint64_t high);
+        // walks all records, builds record index, validates it against file size and pre-sizes storage
+        bool ScanRecords();
+        // validates histogram record header (range, sampling rate and dimension); the first one sets rate and dimension
+        bool CheckHistogramHeader(gmon_cursor cur, uint64_t offset, bool first, uint32_t &num_bins);
+        // decodes all indexed records, using multiple threads when there's a lot of them
+        bool DecodeRecords();
+        // decodes arc and basic block records in given index range; runs in worker threads, so it does not log anything,
+        // offset of malformed record is reported through errorOffset instead
+        void DecodeRecordRange(size_t first, size_t last, std::atomic<bool>* failed, std::atomic<uint64_t>* errorOffset);
+        // decodes arc records not indexed by ScanRecords one by one, resolves and spills them as call sites
+        bool StreamCallGraphArcs();
+        // sorts basic blocks by address and merges repeated ones
+        void MergeBasicBlocks();
 
         // read histogram record from file
-        bool ReadHistogramRecord();
-        // read call-graph record from file
-        bool ReadCallGraphRecord();
-        // read basic block record from file
-        bool ReadBasicBlockRecord();
+        bool ReadHistogramRecord(const gmon_record &rec);
+        // read call-graph record from file; does not log, may run in worker thread
+        bool ReadCallGraphRecord(const gmon_record &rec, callgraph_arc &cg);
+        // read basic block record from file; does not log, may run in worker thread
+        bool ReadBasicBlockRecord(const gmon_record &rec);
 
+        // skips specified count of bytes
+        static bool Skip(gmon_cursor &cur, size_t count);
         // reads platform-dependent word (pointer) from file
-        bool ReadVMA(bfd_vma *target);
+        static bool ReadVMA(gmon_cursor &cur, bfd_vma *target);
         // reads 32-bit integer from file
-        bool Read32(int32_t *target);
+        static bool Read32(gmon_cursor &cur, int32_t *target);
         // reads 64-bit integer from file
-        bool Read64(int64_t *target);
+        static bool Read64(gmon_cursor &cur, int64_t *target);
         // reads specified count of bytes from file
-        bool ReadBytes(void* target, int count);
+        static bool ReadBytes(gmon_cursor &cur, void* target, size_t count);
         // reads string from file
-        bool ReadString(std::string& target);
+        static bool ReadString(gmon_cursor &cur, std::string& target);
 
-        // finds aligned histogram record from supplied PCs
-        histogram* FindHistogram(bfd_vma lowpc, bfd_vma highpc);
-        // clips histogram record to aligned block - lowpc equals highpc on success
-        void ClipHistogramAddress(bfd_vma *lowpc, bfd_vma *highpc);
+        // finds aligned histogram record from supplied PCs and bin count
+        histogram* FindHistogram(bfd_vma lowpc, bfd_vma highpc, uint32_t num_bins);
+        // merges histogram with overlapping histograms into single one of the coarsest scale
+        void MergeHistograms(histogram &record, const std::vector<size_t> &overlapping);
+        // adds samples of source histogram to destination bins, redistributing them proportionally to bin overlap;
+        // destination bins are expected to be about as coarse as source ones or coarser (as merged histograms are)
+        static void ResampleHistogram(const histogram &src, histogram &dst);
+        // retrieves sample buffer from pool of previous loads, if any
+        void TakePooledSamples(std::vector<int> &dst);
+
+        // assigns histogram entry values to function entries; returns false when cancelled
+        bool AssignHistogramEntries(histogram* hist);
+        // retrieves flat profile record of given function, creates it if needed
+        FlatProfileRecord* GetFlatProfileRecord(uint32_t functionIndex);
 
-        // scales entry points of functions and aligns them to fit profiling
-        void ScaleAndAlignEntries();
-        // assigns histogram entry values to function entries
-        void AssignHistogramEntries(histogram* hist);
+        // progress of current load, may be null
+        GmonLoadProgress* m_progress;
+        // symbol filter of current load, may be null
+        const SymbolFilter* m_symbolFilter;
+        // memory budget for call graph arcs of current load, 0 when arcs are kept in memory
+        uint64_t m_arcMemoryBudget;
 
-        // finds function entry using supplied address
-        FunctionEntry* GetFunctionByAddress(uint64_t address, uint32_t* functionIndex = nullptr, bool useScaled = false);
-        // finds function entry list using supplied address range
-        void GetFunctionListByAddressRange(uint64_t lowpc, uint64_t highpc, std::list<uint32_t>* indexList, bool useScaled = false);
+        // binary file used for symbol resolving
+        std::string m_binaryFilename;
+        // identity of binary file, zeroed when it could not be examined
+        binary_identity m_binaryIdentity;
 
         // header read from file
         gmon_header m_header;
@@ -139,9 +337,15 @@ class GmonFile
         uint64_t m_tagCount[MAX_GMON_REC_TYPE];
 
         // histogram storage
-        std::list<histogram*> m_histograms;
+        std::vector<histogram> m_histograms;
+        // sample buffers of histograms from previous loads, ready to be reused
+        std::vector<std::vector<int>> m_samplePool;
         // callgraph arc records
-        std::list<callgraph_arc*> m_callGraphArcs;
+        std::vector<callgraph_arc> m_callGraphArcs;
+        // call sites of streamed arcs, sorted and merged within memory budget
+        ArcSpill m_arcSpill;
+        // basic block records
+        std::vector<basic_block> m_basicBlocks;
 
         // stored histogram dimension
         std::string m_histDimension;
@@ -149,16 +353,32 @@ class GmonFile
         char m_histDimensionAbbrev;
         // stored profiling rate
         uint32_t m_profRate;
-        // stored histogram scale
-        double m_histogramScale;
 
-        // table of addresses of functions
-        std::vector<FunctionEntry> m_functionTable;
+        // symbols of binary with address lookup index, shared with other loads of the same binary
+        std::shared_ptr<const SymbolTable> m_symbols;
 
-        // table of flat profile records
+        // sparse table of flat profile records, sorted by function ID once processed
         std::vector<FlatProfileRecord> m_flatProfile;
+        // function ID to flat profile record index map, used while processing
+        std::unordered_map<uint32_t, uint32_t> m_flatProfileSlots;
+        // samples of histogram bins within function bodies
+        FunctionSampleTable m_functionSamples;
         // call graph map
         CallGraphMap m_callGraph;
+        // call site table, sorted by caller, offset and callee; kept in temporary file when loading within arc memory budget
+        CallSiteTable m_callSites;
+        // condensed call graph for call chain queries, built on first query
+        CallChainIndex m_callChains;
+        // aggregated profile of classes (scopes) of functions, indexed by class ID
+        std::vector<class_profile_record> m_classProfile;
+        // multi-resolution pyramid of merged histogram bins
+        HistogramPyramid m_histogramPyramid;
+        // prefix sums of merged histogram bins
+        SampleIndex m_sampleIndex;
+        // address to source line table, loaded on demand
+        DwarfLineTable m_lineTable;
+        // source line profile, the hottest lines first
+        std::vector<line_profile_record> m_lineProfile;
 };
 
 #endif
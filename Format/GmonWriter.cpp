@@ -0,0 +1,227 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Gmon.h"
+#include "GmonWriter.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+GmonWriter::GmonWriter()
+{
+    m_file = nullptr;
+    m_used = 0;
+    m_failed = false;
+}
+
+GmonWriter::~GmonWriter()
+{
+    if (m_file)
+        fclose(m_file);
+}
+
+bool GmonWriter::Flush()
+{
+    if (!m_file || m_used == 0)
+        return !m_failed;
+
+    if (fwrite(&m_buffer[0], 1, m_used, m_file) != m_used)
+        m_failed = true;
+
+    m_used = 0;
+
+    return !m_failed;
+}
+
+void GmonWriter::PutBytes(const void* data, size_t length)
+{
+    const uint8_t* src = (const uint8_t*)data;
+
+    while (length > 0)
+    {
+        if (m_used == m_buffer.size())
+            Flush();
+
+        size_t chunk = nmin(length, m_buffer.size() - m_used);
+        memcpy(&m_buffer[m_used], src, chunk);
+
+        m_used += chunk;
+        src += chunk;
+        length -= chunk;
+    }
+}
+
+void GmonWriter::Put8(uint8_t value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void GmonWriter::Put32(uint32_t value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void GmonWriter::PutVMA(uint64_t value)
+{
+    bfd_vma vma = (bfd_vma)value;
+    PutBytes(&vma, sizeof(vma));
+}
+
+void GmonWriter::WriteHistograms(const std::vector<histogram> &histograms, uint32_t profRate, const std::string &dimension, char dimensionAbbrev)
+{
+    char dim[15];
+
+    // dimension is fixed-size field, padded with zeroes
+    memset(dim, 0, sizeof(dim));
+    memcpy(dim, dimension.c_str(), nmin(dimension.length(), sizeof(dim)));
+
+    for (size_t h = 0; h < histograms.size(); h++)
+    {
+        const histogram &hist = histograms[h];
+
+        int maxSample = 0;
+        for (uint32_t i = 0; i < hist.num_bins; i++)
+            maxSample = nmax(maxSample, hist.sample[i]);
+
+        // gprof adds samples of records with the same range and bin count, so the bins over 16 bits are spread
+        // to more records; there's always at least one
+        uint32_t passes = nmax((uint32_t)(((int64_t)maxSample + UINT16_MAX - 1) / UINT16_MAX), 1u);
+
+        for (uint32_t p = 0; p < passes; p++)
+        {
+            Put8(GMON_TAG_TIME_HIST);
+            PutVMA(hist.lowpc);
+            PutVMA(hist.highpc);
+            Put32(hist.num_bins);
+            Put32(profRate);
+            PutBytes(dim, sizeof(dim));
+            PutBytes(&dimensionAbbrev, 1);
+
+            int64_t base = (int64_t)p * UINT16_MAX;
+            for (uint32_t i = 0; i < hist.num_bins; i++)
+            {
+                uint16_t count = (uint16_t)nmin(nmax((int64_t)hist.sample[i] - base, (int64_t)0), (int64_t)UINT16_MAX);
+                PutBytes(&count, sizeof(count));
+            }
+        }
+    }
+}
+
+void GmonWriter::WriteArcs(const std::vector<FunctionEntry> &functions, const CallSiteTable &callSites)
+{
+    std::vector<callsite_arc> block;
+    uint64_t pos = 0;
+
+    // table may be kept in temporary file, so it's read by blocks
+    while (callSites.Read(pos, CALL_SITE_TABLE_BLOCK, block) > 0)
+    {
+        pos += block.size();
+
+        for (size_t i = 0; i < block.size(); i++)
+            WriteArc(functions, block[i]);
+    }
+}
+
+void GmonWriter::WriteArc(const std::vector<FunctionEntry> &functions, const callsite_arc &site)
+{
+    // exact call site is kept, callee is identified by its entry point
+    uint64_t frompc = functions[site.caller].address + site.offset;
+    uint64_t selfpc = functions[site.callee].address;
+
+    // gprof adds counts of repeated arcs, so counts over 32 bits are split
+    uint64_t count = site.count;
+    do
+    {
+        uint32_t part = (uint32_t)nmin(count, (uint64_t)UINT32_MAX);
+
+        Put8(GMON_TAG_CG_ARC);
+        PutVMA(frompc);
+        PutVMA(selfpc);
+        Put32(part);
+
+        count -= part;
+    } while (count > 0);
+}
+
+void GmonWriter::WriteBasicBlocks(const std::vector<basic_block> &basicBlocks)
+{
+    for (size_t first = 0; first < basicBlocks.size(); first += GMON_WRITE_BLOCKS_PER_RECORD)
+    {
+        size_t count = nmin(basicBlocks.size() - first, (size_t)GMON_WRITE_BLOCKS_PER_RECORD);
+
+        Put8(GMON_TAG_BB_COUNT);
+        Put32((uint32_t)count);
+
+        for (size_t i = first; i < first + count; i++)
+        {
+            PutVMA(basicBlocks[i].address);
+            PutVMA(basicBlocks[i].count);
+        }
+    }
+}
+
+bool GmonWriter::Write(const char* filename, const std::vector<histogram> &histograms, uint32_t profRate, const std::string &dimension,
+    char dimensionAbbrev, const std::vector<FunctionEntry> &functions, const CallSiteTable &callSites,
+    const std::vector<basic_block> &basicBlocks)
+{
+    LogGated(LOG_VERBOSE, "Writing gmon file %s", filename);
+
+    m_file = fopen(filename, "wb");
+    if (!m_file)
+    {
+        LogFunc(LOG_ERROR, "Could not open output gmon file %s", filename);
+        return false;
+    }
+
+    // the whole buffer is handed to stdio at once, its own buffering is not needed
+    setvbuf(m_file, nullptr, _IONBF, 0);
+
+    m_buffer.resize(GMON_WRITE_BUFFER_SIZE);
+    m_used = 0;
+    m_failed = false;
+
+    gmon_header header;
+    uint32_t version = GMON_VERSION;
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.cookie, GMON_MAGIC, sizeof(header.cookie));
+    memcpy(header.version, &version, sizeof(header.version));
+
+    PutBytes(&header, sizeof(header));
+
+    WriteHistograms(histograms, profRate, dimension, dimensionAbbrev);
+    WriteArcs(functions, callSites);
+    WriteBasicBlocks(basicBlocks);
+
+    Flush();
+
+    if (fclose(m_file) != 0)
+        m_failed = true;
+    m_file = nullptr;
+
+    if (m_failed)
+        LogFunc(LOG_ERROR, "Error while writing gmon file %s", filename);
+    else
+        LogGated(LOG_VERBOSE, "Written %llu histograms, %llu call sites and %llu basic blocks", (unsigned long long)histograms.size(),
+            (unsigned long long)callSites.GetCount(), (unsigned long long)basicBlocks.size());
+
+    return !m_failed;
+}
@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_GMON_WRITER_H
+#define PIVO_GPROF_MODULE_GMON_WRITER_H
+
+#include "UnitIdentifiers.h"
+
+struct histogram;
+struct callsite_arc;
+class CallSiteTable;
+struct basic_block;
+
+// size of output buffer written to file at once
+#define GMON_WRITE_BUFFER_SIZE (1024 * 1024)
+// maximum count of basic blocks in single basic block record
+#define GMON_WRITE_BLOCKS_PER_RECORD 4096
+
+// writes loaded profile back to gmon.out (version 1), readable by gprof; records are streamed directly
+// from supplied tables through fixed-size output buffer. Values are written in host byte order, as the profiled
+// program does and as GmonFile reads them, so the file is meant to be read on the same platform
+class GmonWriter
+{
+    public:
+        GmonWriter();
+        ~GmonWriter();
+
+        // writes gmon file; call sites have to be merged (every caller, offset and callee just once)
+        bool Write(const char* filename, const std::vector<histogram> &histograms, uint32_t profRate, const std::string &dimension,
+            char dimensionAbbrev, const std::vector<FunctionEntry> &functions, const CallSiteTable &callSites,
+            const std::vector<basic_block> &basicBlocks);
+
+    private:
+        // writes histogram records; bins over 16-bit range are split to more records of the same range
+        void WriteHistograms(const std::vector<histogram> &histograms, uint32_t profRate, const std::string &dimension, char dimensionAbbrev);
+        // writes call graph arc records; counts over 32-bit range are split to more records of the same arc
+        void WriteArcs(const std::vector<FunctionEntry> &functions, const CallSiteTable &callSites);
+        // writes records of single call site
+        void WriteArc(const std::vector<FunctionEntry> &functions, const callsite_arc &site);
+        // writes basic block records
+        void WriteBasicBlocks(const std::vector<basic_block> &basicBlocks);
+
+        // writes buffered output to file
+        bool Flush();
+        // appends bytes to output buffer
+        void PutBytes(const void* data, size_t length);
+        // appends single byte (record tag)
+        void Put8(uint8_t value);
+        // appends 32-bit integer
+        void Put32(uint32_t value);
+        // appends platform-dependent word (pointer)
+        void PutVMA(uint64_t value);
+
+        // output file
+        FILE* m_file;
+        // output buffer and count of its used bytes
+        std::vector<uint8_t> m_buffer;
+        size_t m_used;
+        // did any write fail?
+        bool m_failed;
+};
+
+#endif
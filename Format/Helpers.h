@@ -21,18 +21,51 @@
 #ifndef PIVO_GPROF_MODULE_HELPERS_H
 #define PIVO_GPROF_MODULE_HELPERS_H
 
-#define NUM_PIPES          2
-#define PARENT_WRITE_PIPE  0
-#define PARENT_READ_PIPE   1
+#include <sys/types.h>
+#include <stdint.h>
+#include <vector>
 
 #define READ_FD  0
 #define WRITE_FD 1
-#define PARENT_READ_FD(p)  ( p[PARENT_READ_PIPE][READ_FD]   )
-#define PARENT_WRITE_FD(p) ( p[PARENT_WRITE_PIPE][WRITE_FD] )
-#define CHILD_READ_FD(p)   ( p[PARENT_WRITE_PIPE][READ_FD]  )
-#define CHILD_WRITE_FD(p)  ( p[PARENT_READ_PIPE][WRITE_FD]  )
 
-// forks process, executes first parameter in params array, returns file descriptor for reading
-int ForkProcessForReading(const char** params);
+// initial size of buffer for reading child process output
+#define PROCESS_READ_BLOCK_SIZE 65536
+
+// child process spawned with its standard output connected to pipe, which is read line by line
+class ProcessReader
+{
+    public:
+        ProcessReader();
+        // closes pipe and reaps the child, if still running
+        ~ProcessReader();
+
+        // spawns process, executes first parameter in params array
+        bool Start(const char** params);
+        // reads next line of output without copying it; line is null-terminated and valid until next call
+        bool ReadLine(char*& line, size_t& length);
+        // closes pipe and waits for child to exit; returns its exit status, or -1 on failure
+        int Finish();
+
+    private:
+        // reads next block from pipe to buffer; returns false on end of stream
+        bool FillBuffer();
+
+        // child process ID
+        pid_t m_pid;
+        // pipe file descriptor for reading
+        int m_fd;
+
+        // read buffer; grows only when a single line does not fit
+        std::vector<char> m_buffer;
+        // start of unprocessed data in buffer
+        size_t m_bufferPos;
+        // end of valid data in buffer
+        size_t m_bufferEnd;
+        // was end of stream reached?
+        bool m_eof;
+};
+
+// parses single line of nm output (address, type and name); returns false for lines without address
+bool ParseNmLine(char* line, size_t length, uint64_t &address, char &type, char* &name);
 
 #endif
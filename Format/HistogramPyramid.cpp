@@ -0,0 +1,157 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Gmon.h"
+#include "HistogramPyramid.h"
+
+#include <math.h>
+
+HistogramPyramid::HistogramPyramid()
+{
+    m_segmentCount = 0;
+}
+
+void HistogramPyramid::Clear()
+{
+    // keep level vectors allocated, they will be reused by next build
+    m_segmentCount = 0;
+}
+
+void HistogramPyramid::Build(const std::vector<histogram> &histograms)
+{
+    Clear();
+
+    if (m_segments.size() < histograms.size())
+        m_segments.resize(histograms.size());
+
+    for (size_t h = 0; h < histograms.size(); h++)
+    {
+        const histogram &hist = histograms[h];
+
+        if (hist.num_bins == 0 || hist.highpc <= hist.lowpc)
+            continue;
+
+        Segment &seg = m_segments[m_segmentCount++];
+
+        seg.lowpc = hist.lowpc;
+        seg.highpc = hist.highpc;
+        seg.binWidth = (double)(hist.highpc - hist.lowpc) / (double)hist.num_bins;
+
+        // count levels - halve the bin count until single bin remains
+        size_t levelCount = 1;
+        for (uint32_t n = hist.num_bins; n > 1; n = (n + 1) / 2)
+            levelCount++;
+
+        seg.levels.resize(levelCount);
+
+        // level 0 contains original bins
+        std::vector<uint64_t> &base = seg.levels[0];
+        base.resize(hist.num_bins);
+        for (uint32_t i = 0; i < hist.num_bins; i++)
+            base[i] = hist.sample[i] > 0 ? (uint64_t)hist.sample[i] : 0;
+
+        // every other level sums pairs of bins from level below; odd last bin is carried as-is
+        for (size_t l = 1; l < levelCount; l++)
+        {
+            const std::vector<uint64_t> &lower = seg.levels[l - 1];
+            std::vector<uint64_t> &upper = seg.levels[l];
+
+            upper.resize((lower.size() + 1) / 2);
+            for (size_t i = 0; i < upper.size(); i++)
+                upper[i] = lower[2 * i] + ((2 * i + 1 < lower.size()) ? lower[2 * i + 1] : 0);
+        }
+    }
+}
+
+void HistogramPyramid::AddRange(const Segment &seg, uint32_t level, double lowpc, double highpc, double &dst) const
+{
+    const std::vector<uint64_t> &bins = seg.levels[level];
+    size_t baseCount = seg.levels[0].size();
+    size_t span = (size_t)1 << level;
+    double width = seg.binWidth * (double)span;
+    double segLow = (double)seg.lowpc;
+
+    // clip to segment range
+    lowpc = nmax(lowpc, segLow);
+    highpc = nmin(highpc, (double)seg.highpc);
+    if (lowpc >= highpc)
+        return;
+
+    size_t first = (size_t)((lowpc - segLow) / width);
+    size_t last = (size_t)ceil((highpc - segLow) / width);
+    if (last > bins.size())
+        last = bins.size();
+
+    for (size_t i = first; i < last; i++)
+    {
+        if (bins[i] == 0)
+            continue;
+
+        // real bin bounds - last bin of level may cover less base bins than others
+        double binLow = segLow + (double)(i * span) * seg.binWidth;
+        double binHigh = segLow + (double)nmin((i + 1) * span, baseCount) * seg.binWidth;
+
+        double overlap = nmin(highpc, binHigh) - nmax(lowpc, binLow);
+        if (overlap > 0)
+            dst += (double)bins[i] * overlap / (binHigh - binLow);
+    }
+}
+
+bool HistogramPyramid::Query(uint64_t lowpc, uint64_t highpc, uint32_t binCount, std::vector<double> &dst) const
+{
+    dst.assign(binCount, 0.0);
+
+    if (binCount == 0 || highpc <= lowpc)
+        return false;
+
+    double bucketWidth = (double)(highpc - lowpc) / (double)binCount;
+
+    for (size_t s = 0; s < m_segmentCount; s++)
+    {
+        const Segment &seg = m_segments[s];
+
+        if (seg.highpc <= lowpc || seg.lowpc >= highpc)
+            continue;
+
+        // select the coarsest level, which is still at least as fine as output buckets;
+        // every output bucket then touches only a few bins
+        uint32_t level = 0;
+        while (level + 1 < seg.levels.size() && seg.binWidth * (double)((size_t)2 << level) <= bucketWidth)
+            level++;
+
+        // only buckets overlapping this segment are visited
+        uint64_t clipLow = nmax(lowpc, seg.lowpc);
+        uint64_t clipHigh = nmin(highpc, seg.highpc);
+
+        uint32_t firstBucket = (uint32_t)((double)(clipLow - lowpc) / bucketWidth);
+        uint32_t lastBucket = (uint32_t)ceil((double)(clipHigh - lowpc) / bucketWidth);
+        if (lastBucket > binCount)
+            lastBucket = binCount;
+
+        for (uint32_t b = firstBucket; b < lastBucket; b++)
+        {
+            double bucketLow = (double)lowpc + bucketWidth * b;
+            AddRange(seg, level, bucketLow, bucketLow + bucketWidth, dst[b]);
+        }
+    }
+
+    return true;
+}
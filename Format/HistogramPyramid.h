@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_HISTOGRAM_PYRAMID_H
+#define PIVO_GPROF_MODULE_HISTOGRAM_PYRAMID_H
+
+struct histogram;
+
+// multi-resolution pyramid of histogram bins; every level sums pairs of bins
+// from the level below, so heat map of any range could be built at any zoom
+class HistogramPyramid
+{
+    public:
+        HistogramPyramid();
+
+        // builds pyramid levels from merged histograms
+        void Build(const std::vector<histogram> &histograms);
+        // drops all levels, keeps allocated storage
+        void Clear();
+
+        // fills dst with binCount sample sums evenly covering <lowpc; highpc) address range
+        bool Query(uint64_t lowpc, uint64_t highpc, uint32_t binCount, std::vector<double> &dst) const;
+
+    private:
+        // pyramid of single histogram record
+        struct Segment
+        {
+            // covered address range
+            uint64_t lowpc;
+            uint64_t highpc;
+            // address range covered by single bin of the lowest level
+            double binWidth;
+            // levels of summed bins, level 0 contains the original bins
+            std::vector<std::vector<uint64_t>> levels;
+        };
+
+        // adds samples of given segment level in <lowpc; highpc) range to dst
+        void AddRange(const Segment &seg, uint32_t level, double lowpc, double highpc, double &dst) const;
+
+        // pyramid of every histogram record
+        std::vector<Segment> m_segments;
+        // count of used segments; the rest is kept for reuse
+        size_t m_segmentCount;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_LOAD_PROGRESS_H
+#define PIVO_GPROF_MODULE_LOAD_PROGRESS_H
+
+#include <atomic>
+
+// stages of gmon file loading
+enum GmonLoadStage
+{
+    GLS_PENDING = 0,        // load did not start yet
+    GLS_SYMBOLS,            // resolving symbols from binary
+    GLS_RECORDS,            // reading gmon records
+    GLS_HISTOGRAMS,         // attributing histograms to functions
+    GLS_CALL_GRAPH,         // building call graph
+    GLS_DONE,               // load finished successfully
+    GLS_FAILED,             // load failed
+    GLS_CANCELLED           // load was cancelled
+};
+
+// load progress shared between loading thread and observers; all fields may be read anytime
+struct GmonLoadProgress
+{
+    GmonLoadProgress()
+        : stage(GLS_PENDING), bytesTotal(0), bytesRead(0), symbolsResolved(0),
+          histogramsTotal(0), histogramsAttributed(0), arcsTotal(0), arcsProcessed(0), cancelRequested(false)
+    {
+    }
+
+    // current stage, one of GmonLoadStage values
+    std::atomic<int> stage;
+    // gmon file size
+    std::atomic<uint64_t> bytesTotal;
+    // gmon file bytes consumed so far
+    std::atomic<uint64_t> bytesRead;
+    // count of symbols resolved from binary so far
+    std::atomic<uint64_t> symbolsResolved;
+    // count of histogram records to attribute
+    std::atomic<uint64_t> histogramsTotal;
+    // count of histogram records attributed so far
+    std::atomic<uint64_t> histogramsAttributed;
+    // count of call graph arcs to process
+    std::atomic<uint64_t> arcsTotal;
+    // count of call graph arcs processed so far
+    std::atomic<uint64_t> arcsProcessed;
+    // set by observer to request cooperative cancellation
+    std::atomic<bool> cancelRequested;
+};
+
+#endif
@@ -0,0 +1,70 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_LOG_GATE_H
+#define PIVO_GPROF_MODULE_LOG_GATE_H
+
+#include "Log.h"
+
+#include <atomic>
+
+extern void(*LogFunc)(int, const char*, ...);
+
+// the most detailed log level compiled in; messages above it cost nothing, not even a branch
+#ifndef GPROF_LOG_MAX_LEVEL
+#define GPROF_LOG_MAX_LEVEL LOG_DEBUG
+#endif
+
+// runtime log level used when none was set
+#define GPROF_LOG_DEFAULT_LEVEL LOG_VERBOSE
+
+// count of occurrences of counted message logged individually, before only the summary is left
+#define GPROF_LOG_COUNTED_DETAIL 8
+
+// runtime log level of this module; messages above it are not formatted and the logger is not called at all
+class GprofLogLevel
+{
+    public:
+        // retrieves current level
+        static int Get()
+        {
+            return m_level.load(std::memory_order_relaxed);
+        }
+        // sets current level
+        static void Set(int level)
+        {
+            m_level.store(level, std::memory_order_relaxed);
+        }
+
+    private:
+        // cached level, read by every gated message
+        static std::atomic<int> m_level;
+};
+
+// is given log level enabled? compile-time check goes first, so the runtime one is dropped for disabled levels
+#define LOG_ENABLED(level) ((level) <= GPROF_LOG_MAX_LEVEL && (level) <= GprofLogLevel::Get())
+
+// logs message, if its level is enabled; arguments are not evaluated otherwise
+#define LogGated(level, ...) do { if (LOG_ENABLED(level)) LogFunc((level), __VA_ARGS__); } while (0)
+
+// logs one occurrence of repeated message; only the first few are logged, the counter is reported in summary later
+#define LogCounted(counter, level, ...) do { if ((counter)++ < GPROF_LOG_COUNTED_DETAIL) LogGated(level, __VA_ARGS__); } while (0)
+
+#endif
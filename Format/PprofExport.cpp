@@ -0,0 +1,339 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "PprofExport.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+#include "../config_gprof.h"
+
+#include <algorithm>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+// protobuf wire types
+#define PB_WIRE_VARINT 0
+#define PB_WIRE_BYTES 2
+
+// profile.proto field numbers
+enum PprofField
+{
+    PPROF_PROFILE_SAMPLE_TYPE = 1,
+    PPROF_PROFILE_SAMPLE = 2,
+    PPROF_PROFILE_MAPPING = 3,
+    PPROF_PROFILE_LOCATION = 4,
+    PPROF_PROFILE_FUNCTION = 5,
+    PPROF_PROFILE_STRING_TABLE = 6,
+    PPROF_PROFILE_PERIOD_TYPE = 11,
+    PPROF_PROFILE_PERIOD = 12,
+
+    PPROF_VALUETYPE_TYPE = 1,
+    PPROF_VALUETYPE_UNIT = 2,
+
+    PPROF_SAMPLE_LOCATION_ID = 1,
+    PPROF_SAMPLE_VALUE = 2,
+
+    PPROF_MAPPING_ID = 1,
+    PPROF_MAPPING_FILENAME = 5,
+    PPROF_MAPPING_HAS_FUNCTIONS = 7,
+
+    PPROF_LOCATION_ID = 1,
+    PPROF_LOCATION_MAPPING_ID = 2,
+    PPROF_LOCATION_ADDRESS = 3,
+    PPROF_LOCATION_LINE = 4,
+
+    PPROF_LINE_FUNCTION_ID = 1,
+
+    PPROF_FUNCTION_ID = 1,
+    PPROF_FUNCTION_NAME = 2,
+    PPROF_FUNCTION_SYSTEM_NAME = 3
+};
+
+// the only mapping - the profiled binary
+#define PPROF_MAPPING_ID_BINARY 1
+
+PprofExporter::PprofExporter()
+{
+    m_file = nullptr;
+    m_failed = false;
+}
+
+PprofExporter::~PprofExporter()
+{
+    Close();
+}
+
+void PprofExporter::PutVarint(std::string &dst, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        dst += (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+
+    dst += (char)value;
+}
+
+void PprofExporter::PutKey(std::string &dst, uint32_t field, uint32_t wireType)
+{
+    PutVarint(dst, ((uint64_t)field << 3) | wireType);
+}
+
+void PprofExporter::PutVarintField(std::string &dst, uint32_t field, uint64_t value)
+{
+    PutKey(dst, field, PB_WIRE_VARINT);
+    PutVarint(dst, value);
+}
+
+void PprofExporter::PutBytesField(std::string &dst, uint32_t field, const char* data, size_t length)
+{
+    PutKey(dst, field, PB_WIRE_BYTES);
+    PutVarint(dst, length);
+    dst.append(data, length);
+}
+
+bool PprofExporter::Open(const char* filename)
+{
+#ifdef HAVE_ZLIB
+    m_file = gzopen(filename, "wb");
+#else
+    LogGated(LOG_WARNING, "zlib not available, pprof profile will not be compressed");
+    m_file = fopen(filename, "wb");
+#endif
+
+    m_failed = (m_file == nullptr);
+
+    return !m_failed;
+}
+
+bool PprofExporter::Flush()
+{
+    if (!m_file || m_buffer.empty())
+        return !m_failed;
+
+#ifdef HAVE_ZLIB
+    if (gzwrite((gzFile)m_file, m_buffer.data(), (unsigned int)m_buffer.size()) != (int)m_buffer.size())
+        m_failed = true;
+#else
+    if (fwrite(m_buffer.data(), 1, m_buffer.size(), (FILE*)m_file) != m_buffer.size())
+        m_failed = true;
+#endif
+
+    m_buffer.clear();
+
+    return !m_failed;
+}
+
+bool PprofExporter::Close()
+{
+    if (!m_file)
+        return !m_failed;
+
+    Flush();
+
+#ifdef HAVE_ZLIB
+    if (gzclose((gzFile)m_file) != Z_OK)
+        m_failed = true;
+#else
+    if (fclose((FILE*)m_file) != 0)
+        m_failed = true;
+#endif
+
+    m_file = nullptr;
+
+    return !m_failed;
+}
+
+int64_t PprofExporter::Intern(const std::string &str)
+{
+    std::unordered_map<std::string, int64_t>::iterator itr = m_strings.find(str);
+    if (itr != m_strings.end())
+        return itr->second;
+
+    // string table entries are emitted in the order of their indexes, interleaved with other fields
+    int64_t index = (int64_t)m_strings.size();
+    m_strings[str] = index;
+
+    PutBytesField(m_buffer, PPROF_PROFILE_STRING_TABLE, str.data(), str.size());
+
+    return index;
+}
+
+uint64_t PprofExporter::EmitLocation(uint32_t functionId, const std::vector<FunctionEntry> &functions)
+{
+    // function and location IDs are function table indexes shifted by one (zero ID is not valid)
+    uint64_t id = (uint64_t)functionId + 1;
+
+    if (m_emitted[functionId])
+        return id;
+
+    m_emitted[functionId] = true;
+
+    int64_t name = Intern(functions[functionId].name);
+
+    m_message.clear();
+    PutVarintField(m_message, PPROF_FUNCTION_ID, id);
+    PutVarintField(m_message, PPROF_FUNCTION_NAME, name);
+    PutVarintField(m_message, PPROF_FUNCTION_SYSTEM_NAME, name);
+    PutBytesField(m_buffer, PPROF_PROFILE_FUNCTION, m_message.data(), m_message.size());
+
+    m_nested.clear();
+    PutVarintField(m_nested, PPROF_LINE_FUNCTION_ID, id);
+
+    m_message.clear();
+    PutVarintField(m_message, PPROF_LOCATION_ID, id);
+    PutVarintField(m_message, PPROF_LOCATION_MAPPING_ID, PPROF_MAPPING_ID_BINARY);
+    PutVarintField(m_message, PPROF_LOCATION_ADDRESS, functions[functionId].address);
+    PutBytesField(m_message, PPROF_LOCATION_LINE, m_nested.data(), m_nested.size());
+    PutBytesField(m_buffer, PPROF_PROFILE_LOCATION, m_message.data(), m_message.size());
+
+    return id;
+}
+
+void PprofExporter::EmitSample(uint64_t leaf, uint64_t caller, int64_t nanoseconds, int64_t calls)
+{
+    // packed location IDs, leaf first
+    m_nested.clear();
+    PutVarint(m_nested, leaf);
+    if (caller)
+        PutVarint(m_nested, caller);
+
+    m_message.clear();
+    PutBytesField(m_message, PPROF_SAMPLE_LOCATION_ID, m_nested.data(), m_nested.size());
+
+    // packed values, in the order of sample types
+    m_nested.clear();
+    PutVarint(m_nested, (uint64_t)nanoseconds);
+    PutVarint(m_nested, (uint64_t)calls);
+    PutBytesField(m_message, PPROF_SAMPLE_VALUE, m_nested.data(), m_nested.size());
+
+    PutBytesField(m_buffer, PPROF_PROFILE_SAMPLE, m_message.data(), m_message.size());
+
+    if (m_buffer.size() >= PPROF_FLUSH_SIZE)
+        Flush();
+}
+
+bool PprofExporter::Export(const char* filename, const char* binaryFilename, const std::vector<FunctionEntry> &functions,
+    const std::vector<FlatProfileRecord> &flatProfile, const CallGraphMap &callGraph)
+{
+    LogGated(LOG_VERBOSE, "Exporting profile to pprof file %s", filename);
+
+    if (!Open(filename))
+    {
+        LogFunc(LOG_ERROR, "Could not open %s for writing", filename);
+        return false;
+    }
+
+    m_strings.clear();
+    m_emitted.assign(functions.size(), false);
+
+    // string table has to start with empty string
+    Intern("");
+
+    // sample types: self time and call count
+    const char* sampleTypes[2][2] = { { "cpu", "nanoseconds" }, { "calls", "count" } };
+    for (int i = 0; i < 2; i++)
+    {
+        int64_t type = Intern(sampleTypes[i][0]);
+        int64_t unit = Intern(sampleTypes[i][1]);
+
+        m_message.clear();
+        PutVarintField(m_message, PPROF_VALUETYPE_TYPE, type);
+        PutVarintField(m_message, PPROF_VALUETYPE_UNIT, unit);
+        PutBytesField(m_buffer, PPROF_PROFILE_SAMPLE_TYPE, m_message.data(), m_message.size());
+    }
+
+    m_message.clear();
+    PutVarintField(m_message, PPROF_VALUETYPE_TYPE, Intern("cpu"));
+    PutVarintField(m_message, PPROF_VALUETYPE_UNIT, Intern("nanoseconds"));
+    PutBytesField(m_buffer, PPROF_PROFILE_PERIOD_TYPE, m_message.data(), m_message.size());
+
+    // binary mapping
+    int64_t binaryName = Intern(binaryFilename ? binaryFilename : "");
+    m_message.clear();
+    PutVarintField(m_message, PPROF_MAPPING_ID, PPROF_MAPPING_ID_BINARY);
+    PutVarintField(m_message, PPROF_MAPPING_FILENAME, binaryName);
+    PutVarintField(m_message, PPROF_MAPPING_HAS_FUNCTIONS, 1);
+    PutBytesField(m_buffer, PPROF_PROFILE_MAPPING, m_message.data(), m_message.size());
+
+    // total incoming calls of every callee, so self time could be split among callers
+    std::unordered_map<uint32_t, uint64_t> incoming;
+    for (CallGraphMap::const_iterator itr = callGraph.begin(); itr != callGraph.end(); ++itr)
+        for (std::map<uint32_t, uint64_t>::const_iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
+            incoming[sitr->first] += sitr->second;
+
+    // self time of function ID, looked up in flat profile sorted by function ID
+    auto selfTime = [&flatProfile](uint32_t functionId) -> double {
+        std::vector<FlatProfileRecord>::const_iterator fitr = std::lower_bound(flatProfile.begin(), flatProfile.end(), functionId,
+            [](const FlatProfileRecord &rec, uint32_t id) {
+                return rec.functionId < id;
+            });
+        return (fitr != flatProfile.end() && fitr->functionId == functionId) ? fitr->timeTotal : 0.0;
+    };
+
+    // every arc becomes two-frame sample (callee, caller) carrying call count and proportional part of callee self time
+    for (CallGraphMap::const_iterator itr = callGraph.begin(); itr != callGraph.end(); ++itr)
+    {
+        if (itr->first >= functions.size())
+            continue;
+
+        for (std::map<uint32_t, uint64_t>::const_iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
+        {
+            if (sitr->first >= functions.size())
+                continue;
+
+            uint64_t total = incoming[sitr->first];
+            double share = total > 0 ? selfTime(sitr->first) * (double)sitr->second / (double)total : 0.0;
+
+            uint64_t callee = EmitLocation(sitr->first, functions);
+            uint64_t caller = EmitLocation(itr->first, functions);
+
+            EmitSample(callee, caller, (int64_t)(share * 1e9), (int64_t)sitr->second);
+        }
+    }
+
+    // functions, which were never called (or their callers are unknown), get single-frame sample
+    for (size_t i = 0; i < flatProfile.size(); i++)
+    {
+        const FlatProfileRecord &rec = flatProfile[i];
+
+        if (rec.functionId >= functions.size() || rec.timeTotal <= 0.0)
+            continue;
+
+        std::unordered_map<uint32_t, uint64_t>::iterator itr = incoming.find(rec.functionId);
+        if (itr != incoming.end() && itr->second > 0)
+            continue;
+
+        EmitSample(EmitLocation(rec.functionId, functions), 0, (int64_t)(rec.timeTotal * 1e9), (int64_t)rec.callCount);
+    }
+
+    if (!Close())
+    {
+        LogFunc(LOG_ERROR, "Error while writing pprof file %s", filename);
+        return false;
+    }
+
+    LogGated(LOG_VERBOSE, "pprof export finished, %llu strings", (unsigned long long)m_strings.size());
+
+    return true;
+}
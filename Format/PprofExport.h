@@ -0,0 +1,82 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_PPROF_EXPORT_H
+#define PIVO_GPROF_MODULE_PPROF_EXPORT_H
+
+#include "UnitIdentifiers.h"
+#include "FlatProfileStructs.h"
+#include "CallGraphStructs.h"
+
+#include <unordered_map>
+
+// size of output buffer flushed to file at once
+#define PPROF_FLUSH_SIZE (1024 * 1024)
+
+// exports processed profile to pprof protobuf format (gzip compressed when zlib is available);
+// messages are streamed directly from supplied tables, strings are interned as they are first used
+class PprofExporter
+{
+    public:
+        PprofExporter();
+        ~PprofExporter();
+
+        // writes profile to file; flat profile has to be sorted by function ID
+        bool Export(const char* filename, const char* binaryFilename, const std::vector<FunctionEntry> &functions,
+            const std::vector<FlatProfileRecord> &flatProfile, const CallGraphMap &callGraph);
+
+    private:
+        // opens output file
+        bool Open(const char* filename);
+        // flushes buffered output and closes file
+        bool Close();
+        // writes buffered output to file
+        bool Flush();
+
+        // retrieves string table index of supplied string, emits the string when it's new
+        int64_t Intern(const std::string &str);
+        // emits function and its location, if not emitted yet; returns location ID
+        uint64_t EmitLocation(uint32_t functionId, const std::vector<FunctionEntry> &functions);
+        // emits sample with one or two frames
+        void EmitSample(uint64_t leaf, uint64_t caller, int64_t nanoseconds, int64_t calls);
+
+        // protobuf encoding primitives
+        static void PutVarint(std::string &dst, uint64_t value);
+        static void PutKey(std::string &dst, uint32_t field, uint32_t wireType);
+        static void PutVarintField(std::string &dst, uint32_t field, uint64_t value);
+        static void PutBytesField(std::string &dst, uint32_t field, const char* data, size_t length);
+
+        // output file (gzFile when compressing, FILE* otherwise)
+        void* m_file;
+        // buffered top-level message fields
+        std::string m_buffer;
+        // scratch buffers for nested messages
+        std::string m_message;
+        std::string m_nested;
+
+        // interned strings
+        std::unordered_map<std::string, int64_t> m_strings;
+        // was location (and function) already emitted for function ID?
+        std::vector<bool> m_emitted;
+        // did any write fail?
+        bool m_failed;
+};
+
+#endif
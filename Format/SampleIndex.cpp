@@ -0,0 +1,137 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Gmon.h"
+#include "SampleIndex.h"
+
+#include <algorithm>
+
+SampleIndex::SampleIndex()
+{
+    m_segmentCount = 0;
+}
+
+void SampleIndex::Clear()
+{
+    // keep prefix vectors allocated, they will be reused by next build
+    m_segmentCount = 0;
+}
+
+uint64_t SampleIndex::BinLow(const Segment &seg, uint32_t bin)
+{
+    // the same truncation as used when assigning histogram entries to functions
+    return seg.base + (bfd_vma)(seg.scale * bin);
+}
+
+uint32_t SampleIndex::FindBin(const Segment &seg, uint64_t unit)
+{
+    // bins are almost uniform, the estimate may be off by one due to truncation of bin edges
+    uint32_t bin = (uint32_t)nmin((uint64_t)((double)(unit - seg.base) / seg.scale), (uint64_t)seg.binCount - 1);
+
+    while (bin > 0 && BinLow(seg, bin) > unit)
+        bin--;
+    while (bin + 1 < seg.binCount && BinLow(seg, bin + 1) <= unit)
+        bin++;
+
+    return bin;
+}
+
+double SampleIndex::PartialCredit(const Segment &seg, uint32_t bin, uint64_t low, uint64_t high)
+{
+    uint64_t binLow = BinLow(seg, bin);
+    uint64_t binHigh = BinLow(seg, bin + 1);
+
+    low = nmax(low, binLow);
+    high = nmin(high, binHigh);
+    if (high <= low)
+        return 0.0;
+
+    // credit of whole bin is (binHigh - binLow) * samples / scale, covered part gets its proportion
+    return (seg.prefix[bin + 1] - seg.prefix[bin]) * (double)(high - low) / (double)(binHigh - binLow);
+}
+
+void SampleIndex::Build(const std::vector<histogram> &histograms)
+{
+    Clear();
+
+    if (m_segments.size() < histograms.size())
+        m_segments.resize(histograms.size());
+
+    for (size_t h = 0; h < histograms.size(); h++)
+    {
+        const histogram &hist = histograms[h];
+
+        if (hist.num_bins == 0 || hist.scale <= 0.0)
+            continue;
+
+        Segment &seg = m_segments[m_segmentCount++];
+
+        seg.base = hist.lowpc / sizeof(UNIT);
+        seg.scale = hist.scale;
+        seg.binCount = hist.num_bins;
+
+        // credit of every bin equals to what AssignHistogramEntries distributes among functions covering the whole bin
+        seg.prefix.resize(hist.num_bins + 1);
+        seg.prefix[0] = 0.0;
+        for (uint32_t i = 0; i < hist.num_bins; i++)
+        {
+            double width = (double)(BinLow(seg, i + 1) - BinLow(seg, i));
+            seg.prefix[i + 1] = seg.prefix[i] + (hist.sample[i] > 0 ? width * hist.sample[i] / hist.scale : 0.0);
+        }
+    }
+
+    std::sort(m_segments.begin(), m_segments.begin() + m_segmentCount, [](const Segment &a, const Segment &b) {
+        return a.base < b.base;
+    });
+}
+
+double SampleIndex::Query(uint64_t lowpc, uint64_t highpc) const
+{
+    uint64_t low = lowpc / sizeof(UNIT);
+    uint64_t high = highpc / sizeof(UNIT);
+    double sum = 0.0;
+
+    if (high <= low)
+        return 0.0;
+
+    // there's just a few histogram records, every one is answered in constant time
+    for (size_t s = 0; s < m_segmentCount; s++)
+    {
+        const Segment &seg = m_segments[s];
+
+        uint64_t segLow = nmax(low, seg.base);
+        uint64_t segHigh = nmin(high, BinLow(seg, seg.binCount));
+        if (segHigh <= segLow)
+            continue;
+
+        uint32_t first = FindBin(seg, segLow);
+        uint32_t last = FindBin(seg, segHigh - 1);
+
+        sum += PartialCredit(seg, first, segLow, segHigh);
+        if (last != first)
+        {
+            sum += seg.prefix[last] - seg.prefix[first + 1];
+            sum += PartialCredit(seg, last, segLow, segHigh);
+        }
+    }
+
+    return sum;
+}
@@ -0,0 +1,68 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_SAMPLE_INDEX_H
+#define PIVO_GPROF_MODULE_SAMPLE_INDEX_H
+
+struct histogram;
+
+// prefix sums of histogram bins answering sample count of any address range in constant time;
+// bins partially covered by the range are credited the same way as when attributing samples to functions
+class SampleIndex
+{
+    public:
+        SampleIndex();
+
+        // builds prefix sums from merged histograms
+        void Build(const std::vector<histogram> &histograms);
+        // drops all prefix sums, keeps allocated storage
+        void Clear();
+
+        // retrieves count of samples within <lowpc; highpc) address range
+        double Query(uint64_t lowpc, uint64_t highpc) const;
+
+    private:
+        // prefix sums of single histogram record
+        struct Segment
+        {
+            // first address unit of the first bin (see UNIT)
+            uint64_t base;
+            // address units covered by single bin
+            double scale;
+            // bin count
+            uint32_t binCount;
+            // credit of all bins below given bin index
+            std::vector<double> prefix;
+        };
+
+        // retrieves first address unit of given bin
+        static uint64_t BinLow(const Segment &seg, uint32_t bin);
+        // finds bin containing given address unit; unit has to lie within segment
+        static uint32_t FindBin(const Segment &seg, uint64_t unit);
+        // credit of given bin for part of it within <low; high) address units
+        static double PartialCredit(const Segment &seg, uint32_t bin, uint64_t low, uint64_t high);
+
+        // prefix sums of every histogram record, sorted by address
+        std::vector<Segment> m_segments;
+        // count of used segments; the rest is kept for reuse
+        size_t m_segmentCount;
+};
+
+#endif
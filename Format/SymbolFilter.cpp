@@ -0,0 +1,297 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "SymbolFilter.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+
+#include <string.h>
+
+SymbolMatcher::SymbolMatcher()
+{
+    Clear();
+}
+
+void SymbolMatcher::Clear()
+{
+    m_trie.clear();
+    m_trie.push_back({ 0, 0, 0, false, std::vector<uint32_t>() });
+    m_globTails.clear();
+    m_regexSource.clear();
+    m_regex = std::regex();
+    m_hasRegex = false;
+}
+
+bool SymbolMatcher::IsEmpty() const
+{
+    return m_trie.size() == 1 && !m_trie[0].prefixEnd && m_trie[0].globs.empty() && !m_hasRegex;
+}
+
+uint32_t SymbolMatcher::Child(uint32_t node, char c, bool create)
+{
+    uint32_t last = 0;
+
+    for (uint32_t ch = m_trie[node].child; ch != 0; ch = m_trie[ch].sibling)
+    {
+        if (m_trie[ch].c == c)
+            return ch;
+        last = ch;
+    }
+
+    if (!create)
+        return 0;
+
+    uint32_t index = (uint32_t)m_trie.size();
+    m_trie.push_back({ 0, 0, c, false, std::vector<uint32_t>() });
+
+    if (last)
+        m_trie[last].sibling = index;
+    else
+        m_trie[node].child = index;
+
+    return index;
+}
+
+bool SymbolMatcher::Add(SymbolFilterKind kind, const std::string &pattern)
+{
+    if (kind == SFK_REGEX)
+    {
+        // validate the expression alone, so the error could be reported properly
+        try
+        {
+            std::regex test(pattern, std::regex::ECMAScript);
+        }
+        catch (std::regex_error &err)
+        {
+            LogFunc(LOG_ERROR, "Invalid symbol filter expression '%s': %s", pattern.c_str(), err.what());
+            return false;
+        }
+
+        // all expressions are joined to single alternation, so the name is searched just once
+        if (m_hasRegex)
+            m_regexSource += "|";
+        m_regexSource += "(?:" + pattern + ")";
+
+        m_regex = std::regex(m_regexSource, std::regex::ECMAScript | std::regex::optimize | std::regex::nosubs);
+        m_hasRegex = true;
+
+        return true;
+    }
+
+    // literal part of pattern is stored in trie
+    size_t headLength = (kind == SFK_GLOB) ? pattern.find_first_of("*?") : pattern.length();
+    if (headLength == std::string::npos)
+        headLength = pattern.length();
+
+    uint32_t node = 0;
+    for (size_t i = 0; i < headLength; i++)
+        node = Child(node, pattern[i], true);
+
+    if (kind == SFK_PREFIX)
+        m_trie[node].prefixEnd = true;
+    else
+    {
+        m_trie[node].globs.push_back((uint32_t)m_globTails.size());
+        m_globTails.push_back(pattern.substr(headLength));
+    }
+
+    return true;
+}
+
+bool SymbolMatcher::MatchGlob(const char* pattern, const char* name, const char* nameEnd)
+{
+    // iterative wildcard matching, backtracking only to the last star
+    const char* starPattern = nullptr;
+    const char* starName = nullptr;
+
+    while (name < nameEnd)
+    {
+        if (*pattern == '*')
+        {
+            starPattern = ++pattern;
+            starName = name;
+        }
+        else if (*pattern != '\0' && (*pattern == '?' || *pattern == *name))
+        {
+            pattern++;
+            name++;
+        }
+        else if (starPattern)
+        {
+            pattern = starPattern;
+            name = ++starName;
+        }
+        else
+            return false;
+    }
+
+    while (*pattern == '*')
+        pattern++;
+
+    return *pattern == '\0';
+}
+
+bool SymbolMatcher::Matches(const char* name, size_t length) const
+{
+    const char* end = name + length;
+    uint32_t node = 0;
+    size_t i = 0;
+
+    // walk the trie along the name; every node on the way may terminate prefix or start glob tail
+    while (true)
+    {
+        const trie_node &tn = m_trie[node];
+
+        if (tn.prefixEnd)
+            return true;
+
+        for (size_t g = 0; g < tn.globs.size(); g++)
+        {
+            if (MatchGlob(m_globTails[tn.globs[g]].c_str(), name + i, end))
+                return true;
+        }
+
+        if (i == length)
+            break;
+
+        uint32_t next = 0;
+        for (uint32_t ch = tn.child; ch != 0; ch = m_trie[ch].sibling)
+        {
+            if (m_trie[ch].c == name[i])
+            {
+                next = ch;
+                break;
+            }
+        }
+
+        if (!next)
+            break;
+
+        node = next;
+        i++;
+    }
+
+    if (m_hasRegex)
+        return std::regex_search(name, end, m_regex);
+
+    return false;
+}
+
+SymbolFilter::SymbolFilter()
+{
+    //
+}
+
+void SymbolFilter::Clear()
+{
+    for (int i = 0; i < MAX_SFA; i++)
+        m_matchers[i].Clear();
+
+    m_signature.clear();
+}
+
+bool SymbolFilter::IsEmpty() const
+{
+    return m_matchers[SFA_INCLUDE].IsEmpty() && m_matchers[SFA_EXCLUDE].IsEmpty();
+}
+
+bool SymbolFilter::AddRule(SymbolFilterAction action, SymbolFilterKind kind, const char* pattern)
+{
+    if (!m_matchers[action].Add(kind, pattern))
+        return false;
+
+    static const char* kindNames[MAX_SFK] = { "prefix", "glob", "regex" };
+
+    m_signature += (action == SFA_INCLUDE) ? '+' : '-';
+    m_signature += kindNames[kind];
+    m_signature += ':';
+    m_signature += pattern;
+    m_signature += '\n';
+
+    return true;
+}
+
+bool SymbolFilter::Parse(const char* spec)
+{
+    const char* ptr = spec;
+
+    while (*ptr)
+    {
+        size_t len = strcspn(ptr, ";\n");
+        std::string rule(ptr, len);
+        ptr += len;
+        if (*ptr)
+            ptr++;
+
+        if (rule.empty())
+            continue;
+
+        SymbolFilterAction action;
+        if (rule[0] == '+')
+            action = SFA_INCLUDE;
+        else if (rule[0] == '-')
+            action = SFA_EXCLUDE;
+        else
+        {
+            LogFunc(LOG_ERROR, "Symbol filter rule '%s' has to start with + or -", rule.c_str());
+            return false;
+        }
+
+        size_t colon = rule.find(':');
+        if (colon == std::string::npos)
+        {
+            LogFunc(LOG_ERROR, "Symbol filter rule '%s' is missing pattern kind", rule.c_str());
+            return false;
+        }
+
+        std::string kindName = rule.substr(1, colon - 1);
+        SymbolFilterKind kind;
+        if (kindName == "prefix")
+            kind = SFK_PREFIX;
+        else if (kindName == "glob")
+            kind = SFK_GLOB;
+        else if (kindName == "regex")
+            kind = SFK_REGEX;
+        else
+        {
+            LogFunc(LOG_ERROR, "Unknown symbol filter pattern kind '%s'", kindName.c_str());
+            return false;
+        }
+
+        if (!AddRule(action, kind, rule.c_str() + colon + 1))
+            return false;
+    }
+
+    return true;
+}
+
+bool SymbolFilter::Accepts(const char* name, size_t length) const
+{
+    if (!m_matchers[SFA_INCLUDE].IsEmpty() && !m_matchers[SFA_INCLUDE].Matches(name, length))
+        return false;
+
+    return !m_matchers[SFA_EXCLUDE].Matches(name, length);
+}
+
+const std::string& SymbolFilter::GetSignature() const
+{
+    return m_signature;
+}
@@ -0,0 +1,118 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_SYMBOL_FILTER_H
+#define PIVO_GPROF_MODULE_SYMBOL_FILTER_H
+
+#include <regex>
+
+// what to do with symbol matching the rule
+enum SymbolFilterAction
+{
+    SFA_INCLUDE = 0,
+    SFA_EXCLUDE = 1,
+    MAX_SFA
+};
+
+// kind of rule pattern
+enum SymbolFilterKind
+{
+    SFK_PREFIX = 0,     // name starts with pattern
+    SFK_GLOB = 1,       // whole name matches pattern with * and ? wildcards
+    SFK_REGEX = 2,      // regular expression (ECMAScript) matches any part of name
+    MAX_SFK
+};
+
+// set of rules of one action, compiled into single matcher
+class SymbolMatcher
+{
+    public:
+        SymbolMatcher();
+
+        // adds rule to matcher; returns false for invalid pattern
+        bool Add(SymbolFilterKind kind, const std::string &pattern);
+        // drops all rules
+        void Clear();
+
+        // does matcher contain any rules?
+        bool IsEmpty() const;
+        // does the name match any of rules?
+        bool Matches(const char* name, size_t length) const;
+
+    private:
+        // trie node; prefixes and literal heads of globs share one trie
+        struct trie_node
+        {
+            // first child and next sibling node index (0 = none, root is never a child)
+            uint32_t child;
+            uint32_t sibling;
+            // edge character leading to this node
+            char c;
+            // does prefix rule end in this node?
+            bool prefixEnd;
+            // globs with literal head ending in this node (indexes to m_globTails)
+            std::vector<uint32_t> globs;
+        };
+
+        // retrieves child of node reached by character, creates it when requested
+        uint32_t Child(uint32_t node, char c, bool create);
+        // matches glob pattern (without its literal head) against rest of name
+        static bool MatchGlob(const char* pattern, const char* name, const char* nameEnd);
+
+        // trie of prefixes and glob heads
+        std::vector<trie_node> m_trie;
+        // glob patterns past their literal head
+        std::vector<std::string> m_globTails;
+        // regular expression rules, joined to single alternation
+        std::string m_regexSource;
+        std::regex m_regex;
+        bool m_hasRegex;
+};
+
+// include/exclude filter of symbols applied while loading symbol table
+class SymbolFilter
+{
+    public:
+        SymbolFilter();
+
+        // adds single rule; returns false for invalid pattern
+        bool AddRule(SymbolFilterAction action, SymbolFilterKind kind, const char* pattern);
+        // parses rules separated by ';' or newline, in form "<+|-><prefix|glob|regex>:<pattern>"
+        // (+ includes, - excludes); returns false on parse error
+        bool Parse(const char* spec);
+        // drops all rules
+        void Clear();
+
+        // are there any rules?
+        bool IsEmpty() const;
+        // should the symbol be loaded? symbols are loaded, if they match any include rule (or there's none) and no exclude rule
+        bool Accepts(const char* name, size_t length) const;
+
+        // retrieves normalized rule list, identifying the filter
+        const std::string& GetSignature() const;
+
+    private:
+        // compiled rules of both actions
+        SymbolMatcher m_matchers[MAX_SFA];
+        // normalized rule list
+        std::string m_signature;
+};
+
+#endif
@@ -0,0 +1,415 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Helpers.h"
+#include "Gmon.h"
+#include "SymbolTable.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+#include "../config_gprof.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+bool binary_identity::operator==(const binary_identity &other) const
+{
+    return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime;
+}
+
+bool binary_identity::operator!=(const binary_identity &other) const
+{
+    return !(*this == other);
+}
+
+bool binary_identity::operator<(const binary_identity &other) const
+{
+    if (device != other.device)
+        return device < other.device;
+    if (inode != other.inode)
+        return inode < other.inode;
+    if (size != other.size)
+        return size < other.size;
+    return mtime < other.mtime;
+}
+
+bool IdentifyBinary(const char* binaryFilename, binary_identity &dst)
+{
+    struct stat st;
+
+    if (stat(binaryFilename, &st) != 0)
+    {
+        dst.device = 0;
+        dst.inode = 0;
+        dst.size = 0;
+        dst.mtime = 0;
+        return false;
+    }
+
+    dst.device = (uint64_t)st.st_dev;
+    dst.inode = (uint64_t)st.st_ino;
+    dst.size = (uint64_t)st.st_size;
+    dst.mtime = (int64_t)st.st_mtime;
+
+    return true;
+}
+
+SymbolTable::SymbolTable()
+{
+    m_memoryUsage = 0;
+}
+
+bool SymbolTable::Resolve(const char* binaryFilename, const SymbolFilter* filter, GmonLoadProgress* progress)
+{
+    // build nm binary call parameters
+    const char *argv[] = {NM_BINARY_PATH, "-a", "-C", binaryFilename, 0};
+
+    LogGated(LOG_VERBOSE, "Reasolving symbols using application binary");
+
+    ProcessReader nm;
+
+    if (!nm.Start(argv))
+    {
+        LogFunc(LOG_ERROR, "Could not execute nm binary for symbol resolving, no symbols loaded");
+        return false;
+    }
+
+    char* line;
+    size_t length;
+    int cnt;
+    uint64_t laddr;
+    char* name;
+    char fncType;
+    bool cancelled = false;
+
+    // addresses of excluded symbols, kept just to end ranges of loaded functions
+    std::vector<uint64_t> excluded;
+
+    cnt = 0;
+
+    // line reading loop - terminated by end of nm output; lines are read in large blocks and are not length-limited
+    while (nm.ReadLine(line, length))
+    {
+        // parse address, type and name
+        if (!ParseNmLine(line, length, laddr, fncType, name))
+            continue;
+
+        // excluded symbols never enter function table
+        if (filter && !filter->Accepts(name, strlen(name)))
+        {
+            excluded.push_back(laddr);
+            continue;
+        }
+
+        // resolve function type
+        if (fncType == 'T' || fncType == 't')
+            fncType = FET_TEXT;
+        else
+            fncType = FET_MISC;
+
+        // store "the rest of line" as function name to function table; address is scaled by profiling unit,
+        // to be aligned to histogram bins
+        m_functions.push_back({ laddr, laddr / sizeof(UNIT), name, NO_CLASS, (FunctionEntryType)fncType });
+        cnt++;
+
+        if (progress && (cnt % GMON_PROGRESS_RECORD_STEP) == 0)
+        {
+            progress->symbolsResolved = cnt;
+            if (progress->cancelRequested.load(std::memory_order_relaxed))
+            {
+                cancelled = true;
+                break;
+            }
+        }
+
+        // This logging call usually fills console with loads of messages; commented out for sanity reasons
+        //LogGated(LOG_VERBOSE, "Address: %llu, function: %s", laddr, name);
+    }
+
+    // close pipe and reap the child
+    nm.Finish();
+
+    if (progress)
+        progress->symbolsResolved = cnt;
+
+    // sort function entries to allow effective search
+    std::sort(m_functions.begin(), m_functions.end(), FunctionEntrySortPredicate());
+    std::sort(excluded.begin(), excluded.end());
+
+    // function ends at the next symbol, or at excluded symbol placed in between, so excluded code is not absorbed by it
+    size_t e = 0;
+    m_ends.resize(m_functions.size());
+    for (size_t i = 0; i < m_functions.size(); i++)
+    {
+        uint64_t end = (i + 1 < m_functions.size()) ? m_functions[i + 1].address : UINT64_MAX;
+
+        while (e < excluded.size() && excluded[e] <= m_functions[i].address)
+            e++;
+        if (e < excluded.size() && excluded[e] < end)
+            end = excluded[e];
+
+        m_ends[i] = end;
+    }
+
+    // class IDs are derived from names, so they are shared as well
+    m_classTable.Assign(m_functions);
+
+    // table won't grow anymore
+    m_functions.shrink_to_fit();
+
+    m_memoryUsage = sizeof(SymbolTable) + m_functions.capacity() * sizeof(FunctionEntry) + m_ends.capacity() * sizeof(uint64_t);
+    for (size_t i = 0; i < m_functions.size(); i++)
+        m_memoryUsage += m_functions[i].name.capacity() + 1;
+
+    const std::vector<ClassEntry> &classes = m_classTable.GetClasses();
+    m_memoryUsage += classes.capacity() * sizeof(ClassEntry);
+    for (size_t i = 0; i < classes.size(); i++)
+        m_memoryUsage += classes[i].name.capacity() + 1;
+
+    LogGated(LOG_VERBOSE, "Loaded %i symbols from supplied binary file, %llu symbols excluded", cnt, (unsigned long long)excluded.size());
+
+    return !cancelled;
+}
+
+const std::vector<FunctionEntry>& SymbolTable::GetFunctions() const
+{
+    return m_functions;
+}
+
+const ClassTable& SymbolTable::GetClassTable() const
+{
+    return m_classTable;
+}
+
+uint64_t SymbolTable::GetMemoryUsage() const
+{
+    return m_memoryUsage;
+}
+
+size_t SymbolTable::GetFunctionUpperBound(uint64_t address, bool useScaled) const
+{
+    // we assume that m_functions is sorted from lower address to higher
+    // so we are able to perform binary search in O(log(n)) complexity
+    return std::upper_bound(m_functions.begin(), m_functions.end(), address, [useScaled](uint64_t addr, const FunctionEntry &fe) {
+        return addr < (useScaled ? fe.scaled_address : fe.address);
+    }) - m_functions.begin();
+}
+
+uint64_t SymbolTable::GetFunctionEnd(uint32_t functionIndex, bool useScaled) const
+{
+    return useScaled ? m_ends[functionIndex] / sizeof(UNIT) : m_ends[functionIndex];
+}
+
+const FunctionEntry* SymbolTable::GetFunctionByAddress(uint64_t address, uint32_t* functionIndex, bool useScaled) const
+{
+    if (functionIndex)
+        *functionIndex = 0;
+
+    // we are looking for "highest lower address", i.e. for addresses 2, 5, 10, and input address 7, we return entry with address 5
+    size_t bound = GetFunctionUpperBound(address, useScaled);
+    if (bound == 0)
+        return nullptr;
+
+    uint32_t index = (uint32_t)(bound - 1);
+
+    // address may belong to excluded symbol following the function
+    if (address >= GetFunctionEnd(index, useScaled))
+        return nullptr;
+
+    if (functionIndex)
+        *functionIndex = index;
+
+    return &m_functions[index];
+}
+
+void SymbolTable::GetFunctionListByAddressRange(uint64_t lowpc, uint64_t highpc, std::list<uint32_t>* indexList, bool useScaled) const
+{
+    if (lowpc > highpc)
+        return;
+
+    if (!indexList)
+        return;
+
+    indexList->clear();
+
+    // start with function covering lowpc, or with the first function above it, if lowpc is not covered
+    size_t ind = GetFunctionUpperBound(lowpc, useScaled);
+    if (ind > 0 && lowpc < GetFunctionEnd((uint32_t)(ind - 1), useScaled))
+        ind--;
+
+    for (; ind < m_functions.size(); ind++)
+    {
+        if ((useScaled ? m_functions[ind].scaled_address : m_functions[ind].address) >= highpc)
+            break;
+
+        indexList->push_back((uint32_t)ind);
+    }
+}
+
+bool SymbolTableRegistry::binary_key::operator<(const binary_key &other) const
+{
+    if (identity != other.identity)
+        return identity < other.identity;
+    return filter < other.filter;
+}
+
+SymbolTableRegistry::SymbolTableRegistry()
+{
+    m_memoryUsage = 0;
+    m_memoryLimit = SYMBOL_REGISTRY_DEFAULT_LIMIT;
+}
+
+SymbolTableRegistry& SymbolTableRegistry::GetInstance()
+{
+    static SymbolTableRegistry instance;
+
+    return instance;
+}
+
+std::shared_ptr<const SymbolTable> SymbolTableRegistry::GetEmpty()
+{
+    static std::shared_ptr<const SymbolTable> empty = std::make_shared<SymbolTable>();
+
+    return empty;
+}
+
+std::shared_ptr<const SymbolTable> SymbolTableRegistry::Acquire(const char* binaryFilename, const SymbolFilter* filter, GmonLoadProgress* progress)
+{
+    binary_key key;
+
+    // binary is identified by file identity rather than by path, so rebuilt binary gets its own table
+    bool identified = IdentifyBinary(binaryFilename, key.identity);
+    if (identified)
+    {
+        key.filter = filter ? filter->GetSignature() : "";
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        std::map<binary_key, registry_entry>::iterator itr = m_tables.find(key);
+        if (itr != m_tables.end())
+        {
+            m_lru.splice(m_lru.begin(), m_lru, itr->second.lru);
+
+            if (progress)
+                progress->symbolsResolved = itr->second.table->GetFunctions().size();
+
+            LogGated(LOG_VERBOSE, "Reusing %llu symbols of binary file %s", (unsigned long long)itr->second.table->GetFunctions().size(), binaryFilename);
+
+            return Lease(itr);
+        }
+    }
+
+    // resolve without holding the lock, so the loads of other binaries are not blocked meanwhile
+    std::shared_ptr<SymbolTable> table = std::make_shared<SymbolTable>();
+    bool complete = table->Resolve(binaryFilename, filter, progress);
+
+    if (progress && progress->cancelRequested.load(std::memory_order_relaxed))
+        return nullptr;
+
+    // incomplete tables (i.e. when nm failed) are used, but not registered
+    if (!complete || !identified)
+        return table;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // concurrent load could resolve the same binary meanwhile - keep the registered table, so there's just one
+    std::map<binary_key, registry_entry>::iterator itr = m_tables.find(key);
+    if (itr != m_tables.end())
+    {
+        m_lru.splice(m_lru.begin(), m_lru, itr->second.lru);
+        return Lease(itr);
+    }
+
+    m_lru.push_front(key);
+    itr = m_tables.insert(std::make_pair(key, registry_entry{ table, 0, m_lru.begin() })).first;
+    m_memoryUsage += table->GetMemoryUsage();
+
+    // leased first, so the new table is not evicted right away
+    std::shared_ptr<const SymbolTable> leased = Lease(itr);
+    Evict();
+
+    return leased;
+}
+
+std::shared_ptr<const SymbolTable> SymbolTableRegistry::Lease(std::map<binary_key, registry_entry>::iterator itr)
+{
+    itr->second.users++;
+
+    // handed out pointer keeps the table alive by itself, the registry just gets notified when it's dropped
+    std::shared_ptr<const SymbolTable> table = itr->second.table;
+    binary_key key = itr->first;
+
+    return std::shared_ptr<const SymbolTable>(table.get(), [this, key, table](const SymbolTable*) { Release(key); });
+}
+
+void SymbolTableRegistry::Release(const binary_key &key)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    std::map<binary_key, registry_entry>::iterator itr = m_tables.find(key);
+    if (itr == m_tables.end())
+        return;
+
+    itr->second.users--;
+
+    // table could be kept over memory cap only while it was used
+    Evict();
+}
+
+void SymbolTableRegistry::Evict()
+{
+    std::list<binary_key>::iterator itr = m_lru.end();
+
+    while (m_memoryUsage > m_memoryLimit && itr != m_lru.begin())
+    {
+        --itr;
+
+        // tables used by loads would stay in memory anyway
+        std::map<binary_key, registry_entry>::iterator entry = m_tables.find(*itr);
+        if (entry->second.users > 0)
+            continue;
+
+        LogGated(LOG_DEBUG, "Evicting symbol table of %llu symbols", (unsigned long long)entry->second.table->GetFunctions().size());
+
+        m_memoryUsage -= entry->second.table->GetMemoryUsage();
+        m_tables.erase(entry);
+        itr = m_lru.erase(itr);
+    }
+}
+
+void SymbolTableRegistry::SetMemoryLimit(uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_memoryLimit = bytes;
+    Evict();
+}
+
+void SymbolTableRegistry::Flush()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    uint64_t limit = m_memoryLimit;
+
+    m_memoryLimit = 0;
+    Evict();
+    m_memoryLimit = limit;
+}
@@ -0,0 +1,150 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_SYMBOL_TABLE_H
+#define PIVO_GPROF_MODULE_SYMBOL_TABLE_H
+
+#include "UnitIdentifiers.h"
+#include "ClassTable.h"
+#include "SymbolFilter.h"
+#include "LoadProgress.h"
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+
+// default memory cap of symbol tables kept in registry
+#define SYMBOL_REGISTRY_DEFAULT_LIMIT (256ULL * 1024 * 1024)
+
+// identity of binary file; rebuilt binary gets a different one, even when placed on the same path
+struct binary_identity
+{
+    uint64_t device;
+    uint64_t inode;
+    uint64_t size;
+    int64_t mtime;
+
+    bool operator==(const binary_identity &other) const;
+    bool operator!=(const binary_identity &other) const;
+    bool operator<(const binary_identity &other) const;
+};
+
+// retrieves identity of binary file; returns false (and zeroed identity) when the file could not be examined
+bool IdentifyBinary(const char* binaryFilename, binary_identity &dst);
+
+// symbols resolved from single binary, with address lookup index; immutable once resolved, so it could be
+// shared by all loads of the same binary
+class SymbolTable
+{
+    public:
+        SymbolTable();
+
+        // resolves symbols using builtin tools (nm, winnm, ..); symbols rejected by filter (if supplied) are excluded;
+        // returns false if the table is not complete (tool failed or load was cancelled)
+        bool Resolve(const char* binaryFilename, const SymbolFilter* filter, GmonLoadProgress* progress);
+
+        // retrieves functions, sorted by address
+        const std::vector<FunctionEntry>& GetFunctions() const;
+        // retrieves classes of functions
+        const ClassTable& GetClassTable() const;
+        // retrieves approximate memory used by table, in bytes
+        uint64_t GetMemoryUsage() const;
+
+        // retrieves count of functions starting at or below supplied address
+        size_t GetFunctionUpperBound(uint64_t address, bool useScaled) const;
+        // retrieves end address of function (start of the next loaded or excluded symbol)
+        uint64_t GetFunctionEnd(uint32_t functionIndex, bool useScaled) const;
+        // finds function entry using supplied address
+        const FunctionEntry* GetFunctionByAddress(uint64_t address, uint32_t* functionIndex = nullptr, bool useScaled = false) const;
+        // finds function entry list using supplied address range
+        void GetFunctionListByAddressRange(uint64_t lowpc, uint64_t highpc, std::list<uint32_t>* indexList, bool useScaled = false) const;
+
+    private:
+        // table of functions, sorted by address
+        std::vector<FunctionEntry> m_functions;
+        // end addresses of functions; excluded symbols still end their predecessors
+        std::vector<uint64_t> m_ends;
+        // classes (scopes) of functions
+        ClassTable m_classTable;
+        // approximate memory used by table
+        uint64_t m_memoryUsage;
+};
+
+// process-wide registry of symbol tables, keyed by binary identity (device, inode, size, modification time) and
+// symbol filter; tables not used by any load are evicted in least recently used order when over memory cap
+class SymbolTableRegistry
+{
+    public:
+        // retrieves registry instance
+        static SymbolTableRegistry& GetInstance();
+
+        // retrieves symbol table of binary, resolves it when not registered yet; returns null when cancelled
+        std::shared_ptr<const SymbolTable> Acquire(const char* binaryFilename, const SymbolFilter* filter, GmonLoadProgress* progress);
+        // sets memory cap of registered tables, in bytes
+        void SetMemoryLimit(uint64_t bytes);
+        // drops all tables not used by any load
+        void Flush();
+
+        // retrieves shared empty table
+        static std::shared_ptr<const SymbolTable> GetEmpty();
+
+    private:
+        // private constructor - use GetInstance to retrieve the instance
+        SymbolTableRegistry();
+
+        // identity of binary file and symbol filter
+        struct binary_key
+        {
+            binary_identity identity;
+            std::string filter;
+
+            bool operator<(const binary_key &other) const;
+        };
+
+        // registered table, count of loads using it and its position in usage list
+        struct registry_entry
+        {
+            std::shared_ptr<const SymbolTable> table;
+            uint32_t users;
+            std::list<binary_key>::iterator lru;
+        };
+
+        // hands registered table out to load; the table is released back to registry, when the load drops it;
+        // expects locked registry
+        std::shared_ptr<const SymbolTable> Lease(std::map<binary_key, registry_entry>::iterator itr);
+        // releases table handed out by Lease, evicts tables over memory cap
+        void Release(const binary_key &key);
+        // evicts unused tables, the least recently used first, until within memory cap; expects locked registry
+        void Evict();
+
+        // registered tables
+        std::map<binary_key, registry_entry> m_tables;
+        // keys of registered tables, the most recently used first
+        std::list<binary_key> m_lru;
+        // memory used by registered tables
+        uint64_t m_memoryUsage;
+        // memory cap
+        uint64_t m_memoryLimit;
+        // registry is used by background loads as well
+        std::mutex m_mutex;
+};
+
+#endif
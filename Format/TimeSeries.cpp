@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Gmon.h"
+#include "TimeSeries.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+GmonTimeSeries::GmonTimeSeries(uint32_t windowCount, uint64_t windowLength)
+{
+    // at least one window of non-zero length is needed
+    m_windows.resize(windowCount > 0 ? windowCount : 1);
+    m_windowLength = windowLength > 0 ? windowLength : 1;
+    Clear();
+}
+
+void GmonTimeSeries::Clear()
+{
+    for (size_t i = 0; i < m_windows.size(); i++)
+    {
+        m_windows[i].start = 0;
+        m_windows[i].valid = false;
+        m_windows[i].snapshotCount = 0;
+        m_windows[i].functions.clear();
+        m_windows[i].arcs.clear();
+    }
+
+    m_ingested = false;
+    m_functionCount = 0;
+}
+
+bool GmonTimeSeries::Ingest(const GmonFile* gmon, uint64_t timestamp)
+{
+    if (!gmon)
+        return false;
+
+    // all snapshots has to come from the same binary, function IDs would not match otherwise
+    if (m_ingested && m_binaryIdentity != gmon->GetBinaryIdentity())
+    {
+        LogFunc(LOG_ERROR, "Snapshot was taken from different binary than previously ingested ones, ignoring");
+        return false;
+    }
+
+    if (m_ingested && m_functionCount != gmon->GetFunctionCount())
+    {
+        LogFunc(LOG_ERROR, "Snapshot symbol count %llu does not match previously ingested %llu, ignoring",
+            (unsigned long long)gmon->GetFunctionCount(), (unsigned long long)m_functionCount);
+        return false;
+    }
+
+    m_ingested = true;
+    m_binaryIdentity = gmon->GetBinaryIdentity();
+    m_functionCount = gmon->GetFunctionCount();
+
+    uint64_t windowStart = timestamp - (timestamp % m_windowLength);
+    Window &window = m_windows[(timestamp / m_windowLength) % m_windows.size()];
+
+    if (window.valid && window.start > windowStart)
+    {
+        LogGated(LOG_WARNING, "Snapshot at %llu is older than retained history, ignoring", (unsigned long long)timestamp);
+        return false;
+    }
+
+    // window slot is reused for newer time range - drop the old data, but keep the storage
+    if (!window.valid || window.start != windowStart)
+    {
+        window.start = windowStart;
+        window.valid = true;
+        window.snapshotCount = 0;
+        window.functions.clear();
+        window.arcs.clear();
+    }
+
+    MergeFunctions(window, gmon->GetFlatProfile());
+    MergeArcs(window, gmon->GetCallGraph());
+
+    window.snapshotCount++;
+
+    return true;
+}
+
+void GmonTimeSeries::MergeFunctions(Window &window, const std::vector<FlatProfileRecord> &flat)
+{
+    m_functionScratch.clear();
+
+    size_t wpos = 0;
+    timeseries_function rec;
+
+    // both sequences are sorted by function ID, so we merge them in linear time
+    for (size_t i = 0; i < flat.size(); i++)
+    {
+        const FlatProfileRecord &fp = flat[i];
+
+        // sparse storage - only functions with some data
+        if (fp.callCount == 0 && fp.timeTotal <= 0.0)
+            continue;
+
+        while (wpos < window.functions.size() && window.functions[wpos].functionId < fp.functionId)
+            m_functionScratch.push_back(window.functions[wpos++]);
+
+        rec.functionId = fp.functionId;
+        rec.callCount = fp.callCount;
+        rec.timeTotal = fp.timeTotal;
+
+        if (wpos < window.functions.size() && window.functions[wpos].functionId == fp.functionId)
+        {
+            rec.callCount += window.functions[wpos].callCount;
+            rec.timeTotal += window.functions[wpos].timeTotal;
+            wpos++;
+        }
+
+        m_functionScratch.push_back(rec);
+    }
+
+    while (wpos < window.functions.size())
+        m_functionScratch.push_back(window.functions[wpos++]);
+
+    window.functions.swap(m_functionScratch);
+}
+
+void GmonTimeSeries::MergeArcs(Window &window, const CallGraphMap &callGraph)
+{
+    m_arcScratch.clear();
+
+    size_t wpos = 0;
+    timeseries_arc rec;
+
+    // call graph map is ordered by caller and callee, which is the same order as window arcs use
+    for (CallGraphMap::const_iterator itr = callGraph.begin(); itr != callGraph.end(); ++itr)
+    {
+        for (std::map<uint32_t, uint64_t>::const_iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
+        {
+            while (wpos < window.arcs.size() && (window.arcs[wpos].caller < itr->first
+                || (window.arcs[wpos].caller == itr->first && window.arcs[wpos].callee < sitr->first)))
+            {
+                m_arcScratch.push_back(window.arcs[wpos++]);
+            }
+
+            rec.caller = itr->first;
+            rec.callee = sitr->first;
+            rec.count = sitr->second;
+
+            if (wpos < window.arcs.size() && window.arcs[wpos].caller == rec.caller && window.arcs[wpos].callee == rec.callee)
+                rec.count += window.arcs[wpos++].count;
+
+            m_arcScratch.push_back(rec);
+        }
+    }
+
+    while (wpos < window.arcs.size())
+        m_arcScratch.push_back(window.arcs[wpos++]);
+
+    window.arcs.swap(m_arcScratch);
+}
+
+void GmonTimeSeries::Query(uint64_t from, uint64_t to, std::vector<FlatProfileRecord> &flatDst, CallGraphMap &callGraphDst) const
+{
+    std::map<uint32_t, FlatProfileRecord> flat;
+    FlatProfileRecord *fp;
+
+    flatDst.clear();
+    callGraphDst.clear();
+
+    for (size_t i = 0; i < m_windows.size(); i++)
+    {
+        const Window &window = m_windows[i];
+
+        // include every window, which overlaps requested range
+        if (!window.valid || window.start >= to || window.start + m_windowLength <= from)
+            continue;
+
+        for (size_t j = 0; j < window.functions.size(); j++)
+        {
+            const timeseries_function &rec = window.functions[j];
+
+            fp = &flat[rec.functionId];
+            fp->functionId = rec.functionId;
+            fp->callCount += rec.callCount;
+            fp->timeTotal += rec.timeTotal;
+        }
+
+        for (size_t j = 0; j < window.arcs.size(); j++)
+            callGraphDst[window.arcs[j].caller][window.arcs[j].callee] += window.arcs[j].count;
+    }
+
+    flatDst.reserve(flat.size());
+    for (std::map<uint32_t, FlatProfileRecord>::iterator itr = flat.begin(); itr != flat.end(); ++itr)
+    {
+        itr->second.timeTotalPct = 0.0f;
+        flatDst.push_back(itr->second);
+    }
+}
+
+uint64_t GmonTimeSeries::GetOldestTime() const
+{
+    bool found = false;
+    uint64_t oldest = 0;
+
+    for (size_t i = 0; i < m_windows.size(); i++)
+    {
+        if (m_windows[i].valid && (!found || m_windows[i].start < oldest))
+        {
+            oldest = m_windows[i].start;
+            found = true;
+        }
+    }
+
+    return oldest;
+}
+
+uint64_t GmonTimeSeries::GetNewestTime() const
+{
+    uint64_t newest = 0;
+
+    for (size_t i = 0; i < m_windows.size(); i++)
+    {
+        if (m_windows[i].valid && m_windows[i].start + m_windowLength > newest)
+            newest = m_windows[i].start + m_windowLength;
+    }
+
+    return newest;
+}
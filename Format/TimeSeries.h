@@ -0,0 +1,107 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_TIMESERIES_H
+#define PIVO_GPROF_MODULE_TIMESERIES_H
+
+#include "UnitIdentifiers.h"
+#include "FlatProfileStructs.h"
+#include "CallGraphStructs.h"
+#include "SymbolTable.h"
+
+class GmonFile;
+
+// single aggregated call graph arc within time window
+struct timeseries_arc
+{
+    uint32_t caller;
+    uint32_t callee;
+    uint64_t count;
+};
+
+// single aggregated function record within time window
+struct timeseries_function
+{
+    uint32_t functionId;
+    uint64_t callCount;
+    double timeTotal;
+};
+
+// rolling aggregation of periodic gmon snapshots of the same binary; keeps fixed count
+// of time windows in a ring, so the memory stays bounded regardless of how long it runs
+class GmonTimeSeries
+{
+    public:
+        // creates aggregator with windowCount windows, each windowLength time units long
+        GmonTimeSeries(uint32_t windowCount, uint64_t windowLength);
+
+        // ingests processed snapshot taken at supplied time; every snapshot is considered
+        // to contain only data gathered since the previous one
+        bool Ingest(const GmonFile* gmon, uint64_t timestamp);
+
+        // aggregates all retained windows overlapping <from; to) time range
+        void Query(uint64_t from, uint64_t to, std::vector<FlatProfileRecord> &flatDst, CallGraphMap &callGraphDst) const;
+
+        // drops all aggregated data, but keeps allocated window storage
+        void Clear();
+
+        // retrieves time of oldest retained window start, or 0 if nothing is retained
+        uint64_t GetOldestTime() const;
+        // retrieves end of newest retained window, or 0 if nothing is retained
+        uint64_t GetNewestTime() const;
+
+    private:
+        // single window in ring
+        struct Window
+        {
+            // aligned window start time
+            uint64_t start;
+            // is this window in use?
+            bool valid;
+            // count of snapshots merged into this window
+            uint32_t snapshotCount;
+            // non-zero function records, sorted by function ID
+            std::vector<timeseries_function> functions;
+            // arcs, sorted by caller and callee
+            std::vector<timeseries_arc> arcs;
+        };
+
+        // merges snapshot flat profile into window function records
+        void MergeFunctions(Window &window, const std::vector<FlatProfileRecord> &flat);
+        // merges snapshot call graph into window arcs
+        void MergeArcs(Window &window, const CallGraphMap &callGraph);
+
+        // window ring
+        std::vector<Window> m_windows;
+        // length of one window
+        uint64_t m_windowLength;
+        // was anything ingested since the last clear?
+        bool m_ingested;
+        // identity of ingested binary, used for sanity checks
+        binary_identity m_binaryIdentity;
+        // symbol count of ingested binary, differs when snapshots were loaded with different symbol filters
+        size_t m_functionCount;
+
+        // scratch buffers reused during merging to avoid reallocations
+        std::vector<timeseries_function> m_functionScratch;
+        std::vector<timeseries_arc> m_arcScratch;
+};
+
+#endif
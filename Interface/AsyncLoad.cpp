@@ -0,0 +1,81 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#include "General.h"
+#include "Gmon.h"
+#include "AsyncLoad.h"
+
+GprofAsyncLoad::GprofAsyncLoad(const char* file, const char* binaryFile, const SymbolFilter* filter, uint64_t arcMemoryBudget)
+    : m_file(file), m_binaryFile(binaryFile), m_arcMemoryBudget(arcMemoryBudget), m_finished(false), m_result(nullptr)
+{
+    if (filter)
+        m_filter = *filter;
+
+    // thread has to be started as the last step, when all members are ready
+    m_thread = std::thread(&GprofAsyncLoad::Run, this);
+}
+
+GprofAsyncLoad::~GprofAsyncLoad()
+{
+    Cancel();
+
+    if (m_thread.joinable())
+        m_thread.join();
+
+    // result was not claimed
+    delete m_result;
+}
+
+void GprofAsyncLoad::Run()
+{
+    m_result = GmonFile::Load(m_file.c_str(), m_binaryFile.c_str(), &m_progress, &m_filter, m_arcMemoryBudget);
+
+    // Load reports the final stage on its own, unless it failed before creating the wrapper
+    if (!m_result && m_progress.stage != GLS_CANCELLED)
+        m_progress.stage = GLS_FAILED;
+
+    m_finished = true;
+}
+
+const GmonLoadProgress& GprofAsyncLoad::GetProgress() const
+{
+    return m_progress;
+}
+
+void GprofAsyncLoad::Cancel()
+{
+    m_progress.cancelRequested = true;
+}
+
+bool GprofAsyncLoad::IsFinished() const
+{
+    return m_finished;
+}
+
+GmonFile* GprofAsyncLoad::Wait()
+{
+    if (m_thread.joinable())
+        m_thread.join();
+
+    GmonFile* result = m_result;
+    m_result = nullptr;
+
+    return result;
+}
@@ -0,0 +1,74 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+#ifndef PIVO_GPROF_MODULE_ASYNC_LOAD_H
+#define PIVO_GPROF_MODULE_ASYNC_LOAD_H
+
+#include "LoadProgress.h"
+#include "SymbolFilter.h"
+
+#include <thread>
+
+class GmonFile;
+
+// handle of gmon file load running in background thread
+class GprofAsyncLoad
+{
+    public:
+        // starts loading supplied files in background; filter (if supplied) is copied, see GmonFile::Load for arc memory budget
+        GprofAsyncLoad(const char* file, const char* binaryFile, const SymbolFilter* filter = nullptr, uint64_t arcMemoryBudget = 0);
+        // cancels load (if still running) and waits for the thread
+        ~GprofAsyncLoad();
+
+        // retrieves load progress; may be read while loading
+        const GmonLoadProgress& GetProgress() const;
+        // requests cooperative cancellation of load
+        void Cancel();
+        // has the load finished (successfully or not)?
+        bool IsFinished() const;
+
+        // waits for load to finish; returns loaded file (ownership passes to caller) or nullptr on failure
+        GmonFile* Wait();
+
+    private:
+        // background thread routine
+        void Run();
+
+        // gmon file path
+        std::string m_file;
+        // binary file path
+        std::string m_binaryFile;
+        // symbol filter used for load
+        SymbolFilter m_filter;
+        // memory budget for call graph arcs, 0 when unlimited
+        uint64_t m_arcMemoryBudget;
+
+        // progress shared with loading thread
+        GmonLoadProgress m_progress;
+        // set when the loading thread is done
+        std::atomic<bool> m_finished;
+        // loaded file, if any
+        GmonFile* m_result;
+
+        // loading thread
+        std::thread m_thread;
+};
+
+#endif
@@ -0,0 +1,150 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "DaemonClient.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <limits.h>
+#include <stdlib.h>
+
+GprofDaemonClient::GprofDaemonClient()
+{
+    m_fd = -1;
+}
+
+GprofDaemonClient::~GprofDaemonClient()
+{
+    if (m_fd >= 0)
+        close(m_fd);
+}
+
+bool GprofDaemonClient::Connect(const char* socketPath)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(socketPath) >= sizeof(addr.sun_path))
+        return false;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    m_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0)
+        return false;
+
+    if (connect(m_fd, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+    {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    return true;
+}
+
+bool GprofDaemonClient::Query()
+{
+    if (m_fd < 0)
+        return false;
+
+    if (!m_request.Send(m_fd) || !m_response.Receive(m_fd))
+    {
+        LogFunc(LOG_ERROR, "Connection to gprof daemon lost");
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+
+    if (m_response.GetCode() != DRS_OK)
+    {
+        LogFunc(LOG_ERROR, "Gprof daemon refused request %u with status %u", (unsigned int)m_request.GetCode(), (unsigned int)m_response.GetCode());
+        return false;
+    }
+
+    return true;
+}
+
+bool GprofDaemonClient::Load(const char* file, const char* binaryFile, const SymbolFilter* filter, uint64_t arcMemoryBudget)
+{
+    char fileBuf[PATH_MAX], binaryBuf[PATH_MAX];
+
+    // daemon has its own working directory; missing files are left to be reported by local load
+    if (!realpath(file, fileBuf) || !realpath(binaryFile, binaryBuf))
+        return false;
+
+    m_request.Reset(DRQ_LOAD);
+    m_request.PutString(fileBuf);
+    m_request.PutString(binaryBuf);
+    m_request.PutString(filter ? filter->GetSignature() : "");
+    m_request.Put64(arcMemoryBudget);
+
+    if (!Query())
+        return false;
+
+    uint32_t functionCount = 0;
+    m_response.Get32(functionCount);
+
+    LogGated(LOG_VERBOSE, "Profile %s loaded by gprof daemon, %u functions", fileBuf, functionCount);
+
+    return true;
+}
+
+bool GprofDaemonClient::GetClassTable(std::vector<ClassEntry> &dst)
+{
+    m_request.Reset(DRQ_CLASS_TABLE);
+
+    return Query() && DecodeClassTable(m_response, dst);
+}
+
+bool GprofDaemonClient::GetFunctionTable(std::vector<FunctionEntry> &dst)
+{
+    m_request.Reset(DRQ_FUNCTION_TABLE);
+
+    return Query() && DecodeFunctionTable(m_response, dst);
+}
+
+bool GprofDaemonClient::GetFlatProfileData(std::vector<FlatProfileRecord> &dst)
+{
+    m_request.Reset(DRQ_FLAT_PROFILE);
+
+    return Query() && DecodeFlatProfile(m_response, dst);
+}
+
+bool GprofDaemonClient::GetCallGraphMap(CallGraphMap &dst)
+{
+    m_request.Reset(DRQ_CALL_GRAPH);
+
+    return Query() && DecodeCallGraph(m_response, dst);
+}
+
+bool GprofDaemonClient::Shutdown()
+{
+    m_request.Reset(DRQ_SHUTDOWN);
+
+    return Query();
+}
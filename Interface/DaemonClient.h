@@ -0,0 +1,63 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#ifndef PIVO_GPROF_MODULE_DAEMON_CLIENT_H
+#define PIVO_GPROF_MODULE_DAEMON_CLIENT_H
+
+#include "DaemonProtocol.h"
+#include "SymbolFilter.h"
+
+// client of gprof daemon; loads profile within the daemon and retrieves its processed data
+class GprofDaemonClient
+{
+    public:
+        GprofDaemonClient();
+        ~GprofDaemonClient();
+
+        // connects to daemon listening on supplied socket
+        bool Connect(const char* socketPath);
+        // loads profile within daemon (or reuses the warm one); paths are made absolute, as the daemon runs elsewhere
+        bool Load(const char* file, const char* binaryFile, const SymbolFilter* filter, uint64_t arcMemoryBudget);
+
+        // retrieves class table of loaded profile
+        bool GetClassTable(std::vector<ClassEntry> &dst);
+        // retrieves function table of loaded profile
+        bool GetFunctionTable(std::vector<FunctionEntry> &dst);
+        // retrieves flat profile of loaded profile, one record for every function
+        bool GetFlatProfileData(std::vector<FlatProfileRecord> &dst);
+        // retrieves call graph of loaded profile
+        bool GetCallGraphMap(CallGraphMap &dst);
+        // stops the daemon
+        bool Shutdown();
+
+    private:
+        // sends request built in m_request and receives response; returns false unless the daemon succeeded
+        bool Query();
+
+        // connected socket
+        int m_fd;
+        // request being sent
+        DaemonMessage m_request;
+        // last received response
+        DaemonMessage m_response;
+};
+
+#endif
@@ -0,0 +1,372 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "DaemonProtocol.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+
+#include <sys/socket.h>
+#include <errno.h>
+
+// writes the whole buffer to socket; broken connection is reported as failure, not as signal
+static bool SendAll(int fd, const void* data, size_t length)
+{
+    const uint8_t* ptr = (const uint8_t*)data;
+
+    while (length > 0)
+    {
+        ssize_t sent = send(fd, ptr, length, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+            continue;
+        if (sent <= 0)
+            return false;
+
+        ptr += sent;
+        length -= (size_t)sent;
+    }
+
+    return true;
+}
+
+// reads exactly length bytes from socket
+static bool ReceiveAll(int fd, void* data, size_t length)
+{
+    uint8_t* ptr = (uint8_t*)data;
+
+    while (length > 0)
+    {
+        ssize_t received = recv(fd, ptr, length, 0);
+        if (received < 0 && errno == EINTR)
+            continue;
+        if (received <= 0)
+            return false;
+
+        ptr += received;
+        length -= (size_t)received;
+    }
+
+    return true;
+}
+
+DaemonMessage::DaemonMessage()
+{
+    m_code = 0;
+    m_readPos = 0;
+}
+
+void DaemonMessage::Reset(uint16_t code)
+{
+    m_code = code;
+    m_payload.clear();
+    m_readPos = 0;
+}
+
+uint16_t DaemonMessage::GetCode() const
+{
+    return m_code;
+}
+
+void DaemonMessage::PutBytes(const void* data, size_t length)
+{
+    const uint8_t* src = (const uint8_t*)data;
+
+    m_payload.insert(m_payload.end(), src, src + length);
+}
+
+void DaemonMessage::Put8(uint8_t value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void DaemonMessage::Put32(uint32_t value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void DaemonMessage::Put64(uint64_t value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void DaemonMessage::PutFloat(float value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void DaemonMessage::PutDouble(double value)
+{
+    PutBytes(&value, sizeof(value));
+}
+
+void DaemonMessage::PutString(const std::string &value)
+{
+    Put32((uint32_t)value.length());
+    PutBytes(value.c_str(), value.length());
+}
+
+bool DaemonMessage::GetBytes(void* data, size_t length)
+{
+    if (m_payload.size() - m_readPos < length)
+        return false;
+
+    memcpy(data, &m_payload[m_readPos], length);
+    m_readPos += length;
+
+    return true;
+}
+
+bool DaemonMessage::Get8(uint8_t &value)
+{
+    return GetBytes(&value, sizeof(value));
+}
+
+bool DaemonMessage::Get32(uint32_t &value)
+{
+    return GetBytes(&value, sizeof(value));
+}
+
+bool DaemonMessage::Get64(uint64_t &value)
+{
+    return GetBytes(&value, sizeof(value));
+}
+
+bool DaemonMessage::GetFloat(float &value)
+{
+    return GetBytes(&value, sizeof(value));
+}
+
+bool DaemonMessage::GetDouble(double &value)
+{
+    return GetBytes(&value, sizeof(value));
+}
+
+bool DaemonMessage::GetString(std::string &value)
+{
+    uint32_t length;
+
+    if (!Get32(length) || m_payload.size() - m_readPos < length)
+        return false;
+
+    value.assign((const char*)&m_payload[m_readPos], length);
+    m_readPos += length;
+
+    return true;
+}
+
+bool DaemonMessage::Send(int fd) const
+{
+    daemon_message_header header;
+
+    header.length = (uint32_t)m_payload.size();
+    header.version = DAEMON_PROTOCOL_VERSION;
+    header.code = m_code;
+
+    if (!SendAll(fd, &header, sizeof(header)))
+        return false;
+
+    return m_payload.empty() || SendAll(fd, &m_payload[0], m_payload.size());
+}
+
+bool DaemonMessage::Receive(int fd)
+{
+    daemon_message_header header;
+
+    Reset(0);
+
+    if (!ReceiveAll(fd, &header, sizeof(header)))
+        return false;
+
+    if (header.version != DAEMON_PROTOCOL_VERSION)
+    {
+        LogFunc(LOG_ERROR, "Daemon protocol version mismatch (%u, expected %u)", (unsigned int)header.version, DAEMON_PROTOCOL_VERSION);
+        return false;
+    }
+
+    if (header.length > DAEMON_MAX_MESSAGE_SIZE)
+    {
+        LogFunc(LOG_ERROR, "Daemon message too large (%u bytes)", header.length);
+        return false;
+    }
+
+    m_code = header.code;
+    m_payload.resize(header.length);
+
+    return header.length == 0 || ReceiveAll(fd, &m_payload[0], header.length);
+}
+
+void EncodeClassTable(DaemonMessage &msg, const std::vector<ClassEntry> &classes)
+{
+    msg.Put32((uint32_t)classes.size());
+    for (size_t i = 0; i < classes.size(); i++)
+        msg.PutString(classes[i].name);
+}
+
+bool DecodeClassTable(DaemonMessage &msg, std::vector<ClassEntry> &dst)
+{
+    uint32_t count;
+
+    if (!msg.Get32(count))
+        return false;
+
+    // count comes from the peer, so entries are appended one by one instead of preallocating them
+    dst.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        ClassEntry entry;
+        if (!msg.GetString(entry.name))
+            return false;
+
+        dst.push_back(entry);
+    }
+
+    return true;
+}
+
+void EncodeFunctionTable(DaemonMessage &msg, const std::vector<FunctionEntry> &functions)
+{
+    msg.Put32((uint32_t)functions.size());
+    for (size_t i = 0; i < functions.size(); i++)
+    {
+        const FunctionEntry &fe = functions[i];
+
+        msg.Put64(fe.address);
+        msg.Put64(fe.scaled_address);
+        msg.Put32(fe.classId);
+        msg.Put8((uint8_t)fe.functionType);
+        msg.PutString(fe.name);
+    }
+}
+
+bool DecodeFunctionTable(DaemonMessage &msg, std::vector<FunctionEntry> &dst)
+{
+    uint32_t count;
+    uint8_t type;
+
+    if (!msg.Get32(count))
+        return false;
+
+    dst.clear();
+    for (uint32_t i = 0; i < count; i++)
+    {
+        FunctionEntry fe;
+
+        if (!msg.Get64(fe.address) || !msg.Get64(fe.scaled_address) || !msg.Get32(fe.classId) || !msg.Get8(type)
+            || !msg.GetString(fe.name))
+            return false;
+
+        fe.functionType = (FunctionEntryType)type;
+        dst.push_back(fe);
+    }
+
+    return true;
+}
+
+void EncodeFlatProfile(DaemonMessage &msg, uint32_t functionCount, const std::vector<FlatProfileRecord> &profile)
+{
+    msg.Put32(functionCount);
+    msg.Put32((uint32_t)profile.size());
+    for (size_t i = 0; i < profile.size(); i++)
+    {
+        msg.Put32(profile[i].functionId);
+        msg.Put64(profile[i].callCount);
+        msg.PutDouble(profile[i].timeTotal);
+        msg.PutFloat(profile[i].timeTotalPct);
+    }
+}
+
+bool DecodeFlatProfile(DaemonMessage &msg, std::vector<FlatProfileRecord> &dst)
+{
+    uint32_t functionCount, count;
+    FlatProfileRecord rec;
+
+    if (!msg.Get32(functionCount) || !msg.Get32(count))
+        return false;
+
+    // function count comes from the peer; refuse absurd values before expanding the profile
+    if (functionCount > DAEMON_MAX_MESSAGE_SIZE)
+        return false;
+
+    // expand sparse profile to match function table
+    dst.resize(functionCount);
+    for (uint32_t i = 0; i < functionCount; i++)
+    {
+        dst[i].functionId = i;
+        dst[i].callCount = 0;
+        dst[i].timeTotal = 0;
+        dst[i].timeTotalPct = 0.0f;
+    }
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (!msg.Get32(rec.functionId) || !msg.Get64(rec.callCount) || !msg.GetDouble(rec.timeTotal) || !msg.GetFloat(rec.timeTotalPct))
+            return false;
+
+        if (rec.functionId >= functionCount)
+            return false;
+
+        dst[rec.functionId] = rec;
+    }
+
+    return true;
+}
+
+void EncodeCallGraph(DaemonMessage &msg, const CallGraphMap &callGraph)
+{
+    msg.Put32((uint32_t)callGraph.size());
+    for (CallGraphMap::const_iterator itr = callGraph.begin(); itr != callGraph.end(); ++itr)
+    {
+        msg.Put32(itr->first);
+        msg.Put32((uint32_t)itr->second.size());
+        for (std::map<uint32_t, uint64_t>::const_iterator sitr = itr->second.begin(); sitr != itr->second.end(); ++sitr)
+        {
+            msg.Put32(sitr->first);
+            msg.Put64(sitr->second);
+        }
+    }
+}
+
+bool DecodeCallGraph(DaemonMessage &msg, CallGraphMap &dst)
+{
+    uint32_t callers, callees, caller, callee;
+    uint64_t count;
+
+    if (!msg.Get32(callers))
+        return false;
+
+    dst.clear();
+    for (uint32_t i = 0; i < callers; i++)
+    {
+        if (!msg.Get32(caller) || !msg.Get32(callees))
+            return false;
+
+        std::map<uint32_t, uint64_t> &dstCallees = dst[caller];
+        for (uint32_t j = 0; j < callees; j++)
+        {
+            if (!msg.Get32(callee) || !msg.Get64(count))
+                return false;
+
+            dstCallees[callee] = count;
+        }
+    }
+
+    return true;
+}
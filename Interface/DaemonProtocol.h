@@ -0,0 +1,125 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#ifndef PIVO_GPROF_MODULE_DAEMON_PROTOCOL_H
+#define PIVO_GPROF_MODULE_DAEMON_PROTOCOL_H
+
+#include "General.h"
+#include "InputModule.h"
+
+// version of daemon protocol; peers with different version refuse to talk to each other
+#define DAEMON_PROTOCOL_VERSION 1
+// maximum accepted payload of single message, in bytes
+#define DAEMON_MAX_MESSAGE_SIZE (512U * 1024 * 1024)
+
+// request codes, sent by client
+enum DaemonRequest
+{
+    DRQ_LOAD = 1,               // loads (or reuses warm) profile; file, binary, symbol filter, arc memory budget
+    DRQ_CLASS_TABLE,            // retrieves class table of loaded profile
+    DRQ_FUNCTION_TABLE,         // retrieves function table of loaded profile
+    DRQ_FLAT_PROFILE,           // retrieves (sparse) flat profile of loaded profile
+    DRQ_CALL_GRAPH,             // retrieves call graph of loaded profile
+    DRQ_SHUTDOWN                // stops the daemon
+};
+
+// response codes, sent by daemon
+enum DaemonResponse
+{
+    DRS_OK = 0,                 // request succeeded, payload follows
+    DRS_FAILED,                 // request failed (i.e. profile could not be loaded)
+    DRS_NOT_LOADED,             // query was sent before successful load
+    DRS_BAD_REQUEST             // unknown request or malformed payload
+};
+
+// header preceding every message; integers are in host byte order, as the socket is local
+struct daemon_message_header
+{
+    uint32_t length;            // payload length
+    uint16_t version;           // protocol version
+    uint16_t code;              // request or response code
+};
+
+// single protocol message; payload is built by Put* methods and read by Get* methods, which just fail
+// when reading past the end, so malformed message could not do any harm
+class DaemonMessage
+{
+    public:
+        DaemonMessage();
+
+        // drops payload and sets message code
+        void Reset(uint16_t code);
+        // retrieves message code
+        uint16_t GetCode() const;
+
+        // appends integer, floating point value or length-prefixed string
+        void Put8(uint8_t value);
+        void Put32(uint32_t value);
+        void Put64(uint64_t value);
+        void PutFloat(float value);
+        void PutDouble(double value);
+        void PutString(const std::string &value);
+
+        // reads value at read position; returns false when the payload is too short
+        bool Get8(uint8_t &value);
+        bool Get32(uint32_t &value);
+        bool Get64(uint64_t &value);
+        bool GetFloat(float &value);
+        bool GetDouble(double &value);
+        bool GetString(std::string &value);
+
+        // sends message to socket
+        bool Send(int fd) const;
+        // receives message from socket, replacing current contents
+        bool Receive(int fd);
+
+    private:
+        // appends raw bytes
+        void PutBytes(const void* data, size_t length);
+        // reads raw bytes
+        bool GetBytes(void* data, size_t length);
+
+        // message code
+        uint16_t m_code;
+        // payload
+        std::vector<uint8_t> m_payload;
+        // read position within payload
+        size_t m_readPos;
+};
+
+// encodes class table to message
+void EncodeClassTable(DaemonMessage &msg, const std::vector<ClassEntry> &classes);
+// decodes class table from message
+bool DecodeClassTable(DaemonMessage &msg, std::vector<ClassEntry> &dst);
+// encodes function table to message
+void EncodeFunctionTable(DaemonMessage &msg, const std::vector<FunctionEntry> &functions);
+// decodes function table from message
+bool DecodeFunctionTable(DaemonMessage &msg, std::vector<FunctionEntry> &dst);
+// encodes sparse flat profile along with function count, so just functions with samples or calls are sent
+void EncodeFlatProfile(DaemonMessage &msg, uint32_t functionCount, const std::vector<FlatProfileRecord> &profile);
+// decodes flat profile from message, expanded to one record for every function
+bool DecodeFlatProfile(DaemonMessage &msg, std::vector<FlatProfileRecord> &dst);
+// encodes call graph map to message
+void EncodeCallGraph(DaemonMessage &msg, const CallGraphMap &callGraph);
+// decodes call graph map from message
+bool DecodeCallGraph(DaemonMessage &msg, CallGraphMap &dst);
+
+#endif
@@ -0,0 +1,362 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "Gmon.h"
+#include "GprofDaemon.h"
+#include "GprofInputModule.h"
+#include "Log.h"
+#include "LogGate.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <errno.h>
+
+bool GprofDaemon::file_identity::operator==(const file_identity &other) const
+{
+    return device == other.device && inode == other.inode && size == other.size && mtime == other.mtime;
+}
+
+GprofDaemon::GprofDaemon()
+{
+    m_maxProfiles = GPROF_DAEMON_DEFAULT_MAX_PROFILES;
+    m_listenFd = -1;
+    m_shutdown = false;
+}
+
+GprofDaemon::~GprofDaemon()
+{
+    Shutdown();
+    ReapClients(true);
+
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+        unlink(m_socketPath.c_str());
+    }
+}
+
+bool GprofDaemon::Listen(const char* socketPath)
+{
+    struct sockaddr_un addr;
+
+    if (strlen(socketPath) >= sizeof(addr.sun_path))
+    {
+        LogFunc(LOG_ERROR, "Daemon socket path %s is too long", socketPath);
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, socketPath);
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+    {
+        LogFunc(LOG_ERROR, "Could not create daemon socket");
+        return false;
+    }
+
+    bool bound = (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    if (!bound && errno == EADDRINUSE)
+    {
+        // socket file may be left behind by daemon, that did not exit cleanly; replace it, unless someone still listens on it
+        int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        bool alive = (probe >= 0 && connect(probe, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+        if (probe >= 0)
+            close(probe);
+
+        if (alive)
+        {
+            LogFunc(LOG_ERROR, "Another daemon is already listening on %s", socketPath);
+            close(fd);
+            return false;
+        }
+
+        unlink(socketPath);
+        bound = (bind(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0);
+    }
+
+    if (!bound || listen(fd, SOMAXCONN) != 0)
+    {
+        LogFunc(LOG_ERROR, "Could not listen on daemon socket %s", socketPath);
+        close(fd);
+        return false;
+    }
+
+    // profiles are served to anyone able to connect, so keep the socket private to its owner
+    chmod(socketPath, S_IRUSR | S_IWUSR);
+
+    m_listenFd = fd;
+    m_socketPath = socketPath;
+
+    LogGated(LOG_INFO, "Daemon listening on %s", socketPath);
+
+    return true;
+}
+
+void GprofDaemon::Run()
+{
+    while (!m_shutdown)
+    {
+        int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+
+            // listening socket is shut down on shutdown request, any other error is fatal as well
+            if (!m_shutdown)
+                LogFunc(LOG_ERROR, "Daemon could not accept connection, errno %i", errno);
+            break;
+        }
+
+        ReapClients(false);
+
+        m_clients.emplace_back();
+        client_connection &client = m_clients.back();
+        client.fd = fd;
+        client.finished = false;
+        client.thread = std::thread(&GprofDaemon::ServeClient, this, &client);
+    }
+
+    ReapClients(true);
+
+    LogGated(LOG_INFO, "Daemon stopped");
+}
+
+void GprofDaemon::Shutdown()
+{
+    m_shutdown = true;
+
+    // wakes up thread blocked in accept
+    if (m_listenFd >= 0)
+        shutdown(m_listenFd, SHUT_RDWR);
+}
+
+void GprofDaemon::SetMaxProfiles(size_t count)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    m_maxProfiles = count;
+    TrimProfiles();
+}
+
+void GprofDaemon::ReapClients(bool all)
+{
+    for (std::list<client_connection>::iterator itr = m_clients.begin(); itr != m_clients.end(); )
+    {
+        if (!all && !itr->finished)
+        {
+            ++itr;
+            continue;
+        }
+
+        // connected clients are disconnected, so their threads end
+        if (!itr->finished)
+            shutdown(itr->fd, SHUT_RDWR);
+
+        itr->thread.join();
+        close(itr->fd);
+        itr = m_clients.erase(itr);
+    }
+}
+
+bool GprofDaemon::IdentifyFile(const char* filename, file_identity &dst)
+{
+    struct stat st;
+
+    if (stat(filename, &st) != 0)
+        return false;
+
+    dst.device = (uint64_t)st.st_dev;
+    dst.inode = (uint64_t)st.st_ino;
+    dst.size = (uint64_t)st.st_size;
+    dst.mtime = (int64_t)st.st_mtime;
+
+    return true;
+}
+
+void GprofDaemon::TrimProfiles()
+{
+    // profiles still used by clients are released once they load another one or disconnect
+    while (m_profiles.size() > m_maxProfiles)
+        m_profiles.pop_back();
+}
+
+std::shared_ptr<GmonFile> GprofDaemon::AcquireProfile(const std::string &file, const std::string &binaryFile, const std::string &filter,
+    uint64_t arcMemoryBudget)
+{
+    warm_profile profile;
+
+    profile.file = file;
+    profile.binaryFile = binaryFile;
+    profile.filter = filter;
+    profile.arcMemoryBudget = arcMemoryBudget;
+
+    if (!IdentifyFile(file.c_str(), profile.fileIdentity) || !IdentifyFile(binaryFile.c_str(), profile.binaryIdentity))
+    {
+        LogFunc(LOG_ERROR, "Daemon could not access %s or %s", file.c_str(), binaryFile.c_str());
+        return nullptr;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        for (std::list<warm_profile>::iterator itr = m_profiles.begin(); itr != m_profiles.end(); ++itr)
+        {
+            if (itr->file != file || itr->binaryFile != binaryFile || itr->filter != filter || itr->arcMemoryBudget != arcMemoryBudget)
+                continue;
+
+            // profile or binary was rewritten since loaded
+            if (!(itr->fileIdentity == profile.fileIdentity) || !(itr->binaryIdentity == profile.binaryIdentity))
+            {
+                m_profiles.erase(itr);
+                break;
+            }
+
+            m_profiles.splice(m_profiles.begin(), m_profiles, itr);
+
+            LogGated(LOG_VERBOSE, "Daemon reusing warm profile %s", file.c_str());
+
+            return itr->gmon;
+        }
+    }
+
+    SymbolFilter symbolFilter;
+    if (!symbolFilter.Parse(filter.c_str()))
+        return nullptr;
+
+    // load without holding the lock, so the queries of other clients are not blocked meanwhile
+    profile.gmon.reset(GmonFile::Load(file.c_str(), binaryFile.c_str(), nullptr, &symbolFilter, arcMemoryBudget));
+    if (!profile.gmon)
+        return nullptr;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // the same profile could be loaded by another client meanwhile - both are equal, so it does not matter which one stays
+    m_profiles.push_front(profile);
+    for (std::list<warm_profile>::iterator itr = ++m_profiles.begin(); itr != m_profiles.end(); ++itr)
+    {
+        if (itr->file == file && itr->binaryFile == binaryFile && itr->filter == filter && itr->arcMemoryBudget == arcMemoryBudget)
+        {
+            m_profiles.erase(itr);
+            break;
+        }
+    }
+
+    TrimProfiles();
+
+    return profile.gmon;
+}
+
+void GprofDaemon::HandleRequest(DaemonMessage &request, DaemonMessage &response, std::shared_ptr<GmonFile> &profile)
+{
+    if (request.GetCode() == DRQ_LOAD)
+    {
+        std::string file, binaryFile, filter;
+        uint64_t arcMemoryBudget;
+
+        if (!request.GetString(file) || !request.GetString(binaryFile) || !request.GetString(filter) || !request.Get64(arcMemoryBudget))
+        {
+            response.Reset(DRS_BAD_REQUEST);
+            return;
+        }
+
+        // previous profile of this client is released even if the new one fails to load
+        profile = AcquireProfile(file, binaryFile, filter, arcMemoryBudget);
+        if (!profile)
+        {
+            response.Reset(DRS_FAILED);
+            return;
+        }
+
+        response.Reset(DRS_OK);
+        response.Put32((uint32_t)profile->GetFunctionCount());
+        return;
+    }
+
+    if (request.GetCode() == DRQ_SHUTDOWN)
+    {
+        LogGated(LOG_INFO, "Daemon shutdown requested by client");
+
+        Shutdown();
+        response.Reset(DRS_OK);
+        return;
+    }
+
+    if (request.GetCode() < DRQ_CLASS_TABLE || request.GetCode() > DRQ_CALL_GRAPH)
+    {
+        response.Reset(DRS_BAD_REQUEST);
+        return;
+    }
+
+    if (!profile)
+    {
+        response.Reset(DRS_NOT_LOADED);
+        return;
+    }
+
+    response.Reset(DRS_OK);
+
+    // loaded profile is not modified anymore, so it could be read by more clients at once
+    switch (request.GetCode())
+    {
+        case DRQ_CLASS_TABLE:
+        {
+            std::vector<ClassEntry> classes;
+            profile->FillClassTable(classes);
+            EncodeClassTable(response, classes);
+            break;
+        }
+        case DRQ_FUNCTION_TABLE:
+        {
+            std::vector<FunctionEntry> functions;
+            profile->FillFunctionTable(functions);
+            EncodeFunctionTable(response, functions);
+            break;
+        }
+        case DRQ_FLAT_PROFILE:
+            EncodeFlatProfile(response, (uint32_t)profile->GetFunctionCount(), profile->GetFlatProfile());
+            break;
+        case DRQ_CALL_GRAPH:
+            EncodeCallGraph(response, profile->GetCallGraph());
+            break;
+    }
+}
+
+void GprofDaemon::ServeClient(client_connection* client)
+{
+    DaemonMessage request, response;
+    std::shared_ptr<GmonFile> profile;
+
+    while (!m_shutdown && request.Receive(client->fd))
+    {
+        HandleRequest(request, response, profile);
+
+        if (!response.Send(client->fd))
+            break;
+    }
+
+    client->finished = true;
+}
@@ -0,0 +1,119 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#ifndef PIVO_GPROF_MODULE_DAEMON_H
+#define PIVO_GPROF_MODULE_DAEMON_H
+
+#include "DaemonProtocol.h"
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+class GmonFile;
+
+// default maximum count of processed profiles kept warm by daemon
+#define GPROF_DAEMON_DEFAULT_MAX_PROFILES 8
+
+// resident daemon keeping processed profiles (and, through symbol table registry, symbols of their binaries)
+// warm and serving them to clients over local Unix socket; every client is served by its own thread
+class GprofDaemon
+{
+    public:
+        GprofDaemon();
+        ~GprofDaemon();
+
+        // binds listening socket; stale socket file is replaced, but not the one with another daemon listening on it
+        bool Listen(const char* socketPath);
+        // serves clients until shutdown is requested
+        void Run();
+        // requests shutdown; may be called from any thread
+        void Shutdown();
+        // sets maximum count of warm profiles; the least recently used ones are dropped first
+        void SetMaxProfiles(size_t count);
+
+    private:
+        // identity of file on disk, to recognize profile or binary changed since loaded
+        struct file_identity
+        {
+            uint64_t device;
+            uint64_t inode;
+            uint64_t size;
+            int64_t mtime;
+
+            bool operator==(const file_identity &other) const;
+        };
+
+        // processed profile kept warm, along with everything its contents depend on
+        struct warm_profile
+        {
+            std::string file;
+            std::string binaryFile;
+            std::string filter;
+            uint64_t arcMemoryBudget;
+            file_identity fileIdentity;
+            file_identity binaryIdentity;
+            std::shared_ptr<GmonFile> gmon;
+        };
+
+        // connected client and its serving thread
+        struct client_connection
+        {
+            int fd;
+            std::thread thread;
+            std::atomic<bool> finished;
+        };
+
+        // retrieves identity of file; returns false if it does not exist
+        static bool IdentifyFile(const char* filename, file_identity &dst);
+
+        // retrieves warm profile, loads it when not loaded yet or when its files changed; null on failure
+        std::shared_ptr<GmonFile> AcquireProfile(const std::string &file, const std::string &binaryFile, const std::string &filter,
+            uint64_t arcMemoryBudget);
+        // drops the least recently used profiles over maximum count; expects locked profile list
+        void TrimProfiles();
+
+        // serves requests of single client until it disconnects
+        void ServeClient(client_connection* client);
+        // handles single request; profile is the one loaded by this client
+        void HandleRequest(DaemonMessage &request, DaemonMessage &response, std::shared_ptr<GmonFile> &profile);
+        // joins threads of disconnected clients and closes their sockets
+        void ReapClients(bool all);
+
+        // warm profiles, the most recently used first
+        std::list<warm_profile> m_profiles;
+        // maximum count of warm profiles
+        size_t m_maxProfiles;
+        // profile list is shared by client threads
+        std::mutex m_mutex;
+
+        // listening socket and its path
+        int m_listenFd;
+        std::string m_socketPath;
+        // set when shutdown was requested
+        std::atomic<bool> m_shutdown;
+        // connected clients; touched only by thread running the daemon
+        std::list<client_connection> m_clients;
+};
+
+#endif
@@ -21,9 +21,12 @@
 #include "General.h"
 #include "Gmon.h"
 #include "GprofInputModule.h"
+#include "GprofDaemon.h"
 #include "Log.h"
+#include "LogGate.h"
 
 void(*LogFunc)(int, const char*, ...) = nullptr;
+std::atomic<int> GprofLogLevel::m_level(GPROF_LOG_DEFAULT_LEVEL);
 
 extern "C"
 {
@@ -36,16 +39,37 @@ extern "C"
     {
         LogFunc = log;
     }
+
+    DLL_EXPORT_API void SetLogLevel(int level)
+    {
+        // messages above this level are not even formatted
+        GprofLogLevel::Set(level);
+    }
+
+    DLL_EXPORT_API int RunGprofDaemon(const char* socketPath)
+    {
+        // serves clients until one of them requests shutdown
+        GprofDaemon daemon;
+        if (!daemon.Listen(socketPath))
+            return 1;
+
+        daemon.Run();
+
+        return 0;
+    }
 }
 
 GprofInputModule::GprofInputModule()
 {
     m_gmon = nullptr;
+    m_daemon = nullptr;
+    m_arcMemoryBudget = 0;
 }
 
 GprofInputModule::~GprofInputModule()
 {
-    //
+    delete m_gmon;
+    delete m_daemon;
 }
 
 const char* GprofInputModule::ReportName()
@@ -75,25 +99,203 @@ void GprofInputModule::ReportFeatures(IMF_SET &set)
 
 bool GprofInputModule::LoadFile(const char* file, const char* binaryFile)
 {
+    // warm daemon is preferred, local load is the fallback whenever it's not available
+    if (!m_daemonSocket.empty() && LoadFileFromDaemon(file, binaryFile))
+        return true;
+
+    delete m_daemon;
+    m_daemon = nullptr;
+
+    return LoadFileLocally(file, binaryFile);
+}
+
+bool GprofInputModule::LoadFileLocally(const char* file, const char* binaryFile)
+{
+    // reuse existing gmon file wrapper and its storage, if any
+    if (m_gmon)
+    {
+        if (m_gmon->Reload(file, binaryFile, nullptr, &m_symbolFilter, m_arcMemoryBudget))
+            return true;
+
+        // keep the wrapper even on failure, so its storage could be reused next time
+        m_gmon->Reset();
+        return false;
+    }
+
     // instantiate gmon file wrapper class
-    m_gmon = GmonFile::Load(file, binaryFile);
+    m_gmon = GmonFile::Load(file, binaryFile, nullptr, &m_symbolFilter, m_arcMemoryBudget);
     if (!m_gmon)
         return false;
 
     return true;
 }
 
+bool GprofInputModule::LoadFileFromDaemon(const char* file, const char* binaryFile)
+{
+    // connection is kept for following loads and queries
+    if (!m_daemon)
+    {
+        m_daemon = new GprofDaemonClient;
+        if (!m_daemon->Connect(m_daemonSocket.c_str()))
+        {
+            LogGated(LOG_VERBOSE, "Gprof daemon not available on %s, loading locally", m_daemonSocket.c_str());
+            return false;
+        }
+    }
+
+    if (!m_daemon->Load(file, binaryFile, &m_symbolFilter, m_arcMemoryBudget))
+        return false;
+
+    // kept for the case the daemon becomes unavailable later
+    m_daemonFile = file;
+    m_daemonBinaryFile = binaryFile;
+
+    // locally loaded data are not valid anymore; storage is kept for the case of later local load
+    if (m_gmon)
+        m_gmon->Reset();
+
+    return true;
+}
+
+bool GprofInputModule::FallBackToLocalLoad()
+{
+    LogGated(LOG_WARNING, "Gprof daemon query failed, loading %s locally", m_daemonFile.c_str());
+
+    delete m_daemon;
+    m_daemon = nullptr;
+
+    return LoadFileLocally(m_daemonFile.c_str(), m_daemonBinaryFile.c_str());
+}
+
+bool GprofInputModule::HasLocalProfile() const
+{
+    if (m_daemon)
+    {
+        LogFunc(LOG_ERROR, "Query is not available for file loaded by gprof daemon, load it locally");
+        return false;
+    }
+
+    if (!m_gmon)
+    {
+        LogFunc(LOG_ERROR, "No file loaded");
+        return false;
+    }
+
+    return true;
+}
+
+void GprofInputModule::SetDaemonSocket(const char* socketPath)
+{
+    m_daemonSocket = socketPath ? socketPath : "";
+}
+
+bool GprofInputModule::SetSymbolFilter(const char* spec)
+{
+    m_symbolFilter.Clear();
+
+    if (!spec)
+        return true;
+
+    // do not leave partially parsed rules behind
+    if (!m_symbolFilter.Parse(spec))
+    {
+        m_symbolFilter.Clear();
+        return false;
+    }
+
+    return true;
+}
+
+void GprofInputModule::SetArcMemoryBudget(uint64_t bytes)
+{
+    m_arcMemoryBudget = bytes;
+}
+
+void GprofInputModule::SetSymbolCacheLimit(uint64_t bytes)
+{
+    SymbolTableRegistry::GetInstance().SetMemoryLimit(bytes);
+}
+
+void GprofInputModule::FlushSymbolCache()
+{
+    SymbolTableRegistry::GetInstance().Flush();
+}
+
+GprofAsyncLoad* GprofInputModule::LoadFileAsync(const char* file, const char* binaryFile)
+{
+    return new GprofAsyncLoad(file, binaryFile, &m_symbolFilter, m_arcMemoryBudget);
+}
+
+bool GprofInputModule::FinishLoadAsync(GprofAsyncLoad* handle)
+{
+    if (!handle)
+        return false;
+
+    GmonFile* gmon = handle->Wait();
+    delete handle;
+
+    if (!gmon)
+        return false;
+
+    // replace previously loaded data
+    delete m_gmon;
+    m_gmon = gmon;
+
+    delete m_daemon;
+    m_daemon = nullptr;
+
+    return true;
+}
+
 void GprofInputModule::GetClassTable(std::vector<ClassEntry> &dst)
 {
     dst.clear();
 
-    // TODO: implement this
+    if (m_daemon)
+    {
+        if (m_daemon->GetClassTable(dst))
+            return;
+
+        // partially received data are dropped
+        dst.clear();
+        if (!FallBackToLocalLoad())
+            return;
+    }
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->FillClassTable(dst);
+}
+
+void GprofInputModule::GetClassProfileData(std::vector<class_profile_record> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->FillClassProfileTable(dst);
 }
 
 void GprofInputModule::GetFunctionTable(std::vector<FunctionEntry> &dst)
 {
     dst.clear();
 
+    if (m_daemon)
+    {
+        if (m_daemon->GetFunctionTable(dst))
+            return;
+
+        // partially received data are dropped
+        dst.clear();
+        if (!FallBackToLocalLoad())
+            return;
+    }
+
+    if (!HasLocalProfile())
+        return;
+
     m_gmon->FillFunctionTable(dst);
 }
 
@@ -101,13 +303,169 @@ void GprofInputModule::GetFlatProfileData(std::vector<FlatProfileRecord> &dst)
 {
     dst.clear();
 
+    if (m_daemon)
+    {
+        if (m_daemon->GetFlatProfileData(dst))
+            return;
+
+        // partially received data are dropped
+        dst.clear();
+        if (!FallBackToLocalLoad())
+            return;
+    }
+
+    if (!HasLocalProfile())
+        return;
+
     m_gmon->FillFlatProfileTable(dst);
 }
 
+void GprofInputModule::GetSparseFlatProfileData(std::vector<FlatProfileRecord> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->FillSparseFlatProfileTable(dst);
+}
+
+void GprofInputModule::GetTopFlatProfileData(std::vector<FlatProfileRecord> &dst, uint32_t count)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->FillTopFlatProfileTable(dst, count);
+}
+
+void GprofInputModule::GetCallSitesByCaller(uint32_t caller, std::vector<callsite_arc> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->GetCallSitesByCaller(caller, dst);
+}
+
+void GprofInputModule::GetCallSitesByCallee(uint32_t callee, std::vector<callsite_arc> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->GetCallSitesByCallee(callee, dst);
+}
+
+void GprofInputModule::GetHeaviestCallChains(uint32_t function, CallChainDirection direction, uint32_t count, std::vector<call_chain> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->GetHeaviestCallChains(function, direction, count, dst);
+}
+
+void GprofInputModule::GetHottestOffsets(uint32_t function, uint32_t count, std::vector<function_sample> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->GetHottestOffsets(function, count, dst);
+}
+
+bool GprofInputModule::GetHeatMap(uint64_t lowpc, uint64_t highpc, uint32_t binCount, std::vector<double> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return false;
+
+    return m_gmon->GetHeatMap(lowpc, highpc, binCount, dst);
+}
+
+double GprofInputModule::GetRangeTime(uint64_t lowpc, uint64_t highpc)
+{
+    if (!HasLocalProfile())
+        return 0.0;
+
+    return m_gmon->GetRangeTime(lowpc, highpc);
+}
+
+bool GprofInputModule::BuildLineProfile()
+{
+    if (!HasLocalProfile())
+        return false;
+
+    return m_gmon->BuildLineProfile();
+}
+
+void GprofInputModule::GetLineProfileData(std::vector<line_profile_record> &dst)
+{
+    dst.clear();
+
+    if (!HasLocalProfile())
+        return;
+
+    m_gmon->FillLineProfileTable(dst);
+}
+
+const char* GprofInputModule::GetSourceFileName(uint32_t file)
+{
+    if (!HasLocalProfile())
+        return "";
+
+    return m_gmon->GetSourceFileName(file);
+}
+
+bool GprofInputModule::WriteFunctionOrder(const char* hotFilename, const char* coldFilename, FunctionOrderFormat format)
+{
+    if (!HasLocalProfile())
+        return false;
+
+    return m_gmon->WriteFunctionOrder(hotFilename, coldFilename, format);
+}
+
+bool GprofInputModule::ExportPprof(const char* filename)
+{
+    if (!HasLocalProfile())
+        return false;
+
+    return m_gmon->ExportPprof(filename);
+}
+
+bool GprofInputModule::WriteGmon(const char* filename)
+{
+    if (!HasLocalProfile())
+        return false;
+
+    return m_gmon->WriteGmon(filename);
+}
+
 void GprofInputModule::GetCallGraphMap(CallGraphMap &dst)
 {
     dst.clear();
 
+    if (m_daemon)
+    {
+        if (m_daemon->GetCallGraphMap(dst))
+            return;
+
+        // partially received data are dropped
+        dst.clear();
+        if (!FallBackToLocalLoad())
+            return;
+    }
+
+    if (!HasLocalProfile())
+        return;
+
     m_gmon->FillCallGraphMap(dst);
 }
 
@@ -23,6 +23,9 @@
 
 #include "InputModule.h"
 #include "InputModuleFeatures.h"
+#include "Gmon.h"
+#include "AsyncLoad.h"
+#include "DaemonClient.h"
 
 extern void(*LogFunc)(int, const char*, ...);
 
@@ -43,12 +46,79 @@ class GprofInputModule : public InputModule
         virtual void GetCallGraphMap(CallGraphMap &dst);
         virtual void GetCallTreeMap(CallTreeMap &dst);
 
+        // sets symbol include/exclude rules (see SymbolFilter::Parse) applied on following loads; null clears them
+        bool SetSymbolFilter(const char* spec);
+        // sets memory budget (in bytes) for call graph arcs of following loads, arcs over it are spilled to disk; 0 = unlimited
+        void SetArcMemoryBudget(uint64_t bytes);
+        // sets memory cap (in bytes) of symbol tables shared among loads of the same binaries within this process
+        void SetSymbolCacheLimit(uint64_t bytes);
+        // drops shared symbol tables not used by any loaded file
+        void FlushSymbolCache();
+        // sets socket of gprof daemon (see RunGprofDaemon) used by following loads; null loads files locally again;
+        // files loaded by daemon serve just the InputModule queries, the rest fail until the file is loaded locally
+        void SetDaemonSocket(const char* socketPath);
+        // starts loading files in background; the handle has to be passed to FinishLoadAsync
+        GprofAsyncLoad* LoadFileAsync(const char* file, const char* binaryFile);
+        // waits for background load to finish, takes over its result and destroys the handle
+        bool FinishLoadAsync(GprofAsyncLoad* handle);
+
+        // retrieves flat profile records only for functions with any samples or calls
+        void GetSparseFlatProfileData(std::vector<FlatProfileRecord> &dst);
+        // retrieves flat profile records of at most count hottest functions
+        void GetTopFlatProfileData(std::vector<FlatProfileRecord> &dst, uint32_t count);
+        // retrieves call sites within given caller function
+        void GetCallSitesByCaller(uint32_t caller, std::vector<callsite_arc> &dst);
+        // retrieves call sites calling given callee function
+        void GetCallSitesByCallee(uint32_t callee, std::vector<callsite_arc> &dst);
+        // retrieves at most count heaviest call chains leading to (or from) given function
+        void GetHeaviestCallChains(uint32_t function, CallChainDirection direction, uint32_t count, std::vector<call_chain> &dst);
+        // retrieves at most count hottest address ranges (offsets from function start) within given function
+        void GetHottestOffsets(uint32_t function, uint32_t count, std::vector<function_sample> &dst);
+        // retrieves heat map of binCount buckets evenly covering given address range
+        bool GetHeatMap(uint64_t lowpc, uint64_t highpc, uint32_t binCount, std::vector<double> &dst);
+        // retrieves time spent within <lowpc; highpc) address range
+        double GetRangeTime(uint64_t lowpc, uint64_t highpc);
+        // builds source line profile; returns false if line table is not available
+        bool BuildLineProfile();
+        // retrieves source line profile, the hottest lines first
+        void GetLineProfileData(std::vector<line_profile_record> &dst);
+        // retrieves source file name of line profile record
+        const char* GetSourceFileName(uint32_t file);
+        // writes linker function order file and cold function list
+        bool WriteFunctionOrder(const char* hotFilename, const char* coldFilename, FunctionOrderFormat format);
+        // retrieves aggregated self time and calls of classes, indexed by class ID
+        void GetClassProfileData(std::vector<class_profile_record> &dst);
+        // exports loaded profile to pprof file
+        bool ExportPprof(const char* filename);
+        // writes loaded profile to gmon.out file
+        bool WriteGmon(const char* filename);
+
     protected:
         //
 
     private:
+        // loads file within daemon; returns false when daemon is not available or failed to load it
+        bool LoadFileFromDaemon(const char* file, const char* binaryFile);
+        // loads file within this process, reusing storage of previously loaded one
+        bool LoadFileLocally(const char* file, const char* binaryFile);
+        // drops daemon connection after failed query and loads the file locally instead
+        bool FallBackToLocalLoad();
+        // is the file loaded locally? extended queries are not served by daemon; logs error if not
+        bool HasLocalProfile() const;
+
         // gmon.out file wrapper class instance
         GmonFile* m_gmon;
+        // client of daemon holding currently loaded file, null when loaded locally
+        GprofDaemonClient* m_daemon;
+        // daemon socket path, empty when not used
+        std::string m_daemonSocket;
+        // files loaded by daemon
+        std::string m_daemonFile;
+        std::string m_daemonBinaryFile;
+        // filter of symbols applied on load
+        SymbolFilter m_symbolFilter;
+        // memory budget for call graph arcs applied on load
+        uint64_t m_arcMemoryBudget;
 };
 
 #endif
@@ -0,0 +1,80 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "ClassTable.h"
+#include "TestCommon.h"
+
+extern "C" void RegisterLogger(void(*log)(int, const char*, ...));
+
+// demangled name and its expected scope, null when there's none
+struct scope_case
+{
+    const char* name;
+    const char* scope;
+};
+
+static const scope_case scopeCases[] = {
+    { "main", nullptr },
+    { "foo(int)", nullptr },
+    { "operator new(unsigned long)", nullptr },
+    { "ns::foo(int)", "ns" },
+    { "a::b::c", "a::b" },
+    { "ns::Cls::method() const", "ns::Cls" },
+    { "Cls::Cls()", "Cls" },
+    // template arguments and return type of template functions
+    { "std::vector<int, std::allocator<int> >::push_back(int const&)", "std::vector<int, std::allocator<int> >" },
+    { "std::map<a::b, c::d>::find(a::b const&)", "std::map<a::b, c::d>" },
+    { "void ns::tmpl<int>(int)", "ns" },
+    // operators containing nesting characters
+    { "Cls::operator<(Cls const&) const", "Cls" },
+    { "Cls::operator()()", "Cls" },
+    // local entities, lambdas, anonymous namespaces, thunks and ABI tags
+    { "(anonymous namespace)::helper()", "(anonymous namespace)" },
+    { "ns::outer()::Local::run()", "ns::outer()::Local" },
+    { "ns::Cls::method()::{lambda(int)#1}::operator()(int) const", "ns::Cls::method()::{lambda(int)#1}" },
+    { "non-virtual thunk to ns::Cls::~Cls()", "ns::Cls" },
+    { "ns::f[abi:cxx11]()", "ns" },
+};
+
+int main()
+{
+    RegisterLogger(TestLogger);
+
+    for (size_t i = 0; i < sizeof(scopeCases) / sizeof(scopeCases[0]); i++)
+    {
+        const scope_case &sc = scopeCases[i];
+        size_t scopeStart = 0, scopeLength = 0;
+
+        bool found = ClassTable::FindScope(sc.name, strlen(sc.name), scopeStart, scopeLength);
+
+        TEST_CHECK(found == (sc.scope != nullptr));
+        if (found && sc.scope)
+        {
+            std::string scope(sc.name + scopeStart, scopeLength);
+            if (scope != sc.scope)
+                fprintf(stderr, "Scope of %s: expected '%s', found '%s'\n", sc.name, sc.scope, scope.c_str());
+            TEST_CHECK(scope == sc.scope);
+        }
+    }
+
+    return TestResult();
+}
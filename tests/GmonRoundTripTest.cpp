@@ -0,0 +1,226 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "Gmon.h"
+#include "TestCommon.h"
+
+extern "C" void RegisterLogger(void(*log)(int, const char*, ...));
+
+// count of functions covered by generated profile
+#define ROUNDTRIP_FUNCTION_COUNT 32
+
+// builds gmon.out with histogram and arcs covering functions of supplied symbol table
+static bool WriteSourceGmon(const char* filename, const SymbolTable &symbols)
+{
+    const std::vector<FunctionEntry> &functions = symbols.GetFunctions();
+    if (functions.size() < ROUNDTRIP_FUNCTION_COUNT + 1)
+        return false;
+
+    FILE* f = fopen(filename, "wb");
+    if (!f)
+        return false;
+
+    gmon_header header;
+    uint32_t version = GMON_VERSION;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.cookie, GMON_MAGIC, 4);
+    memcpy(header.version, &version, 4);
+    fwrite(&header, sizeof(header), 1, f);
+
+    // histogram with four bytes wide bins over all covered functions
+    bfd_vma lowpc = (bfd_vma)(functions[0].address & ~(uint64_t)1);
+    bfd_vma highpc = (bfd_vma)((symbols.GetFunctionEnd(ROUNDTRIP_FUNCTION_COUNT - 1, false) + 1) & ~(uint64_t)1);
+    uint32_t num_bins = (uint32_t)((highpc - lowpc) / 4);
+    uint32_t profRate = 100;
+    char dimension[15] = "seconds";
+    char abbrev = 's';
+
+    fputc(GMON_TAG_TIME_HIST, f);
+    fwrite(&lowpc, sizeof(lowpc), 1, f);
+    fwrite(&highpc, sizeof(highpc), 1, f);
+    fwrite(&num_bins, sizeof(num_bins), 1, f);
+    fwrite(&profRate, sizeof(profRate), 1, f);
+    fwrite(dimension, sizeof(dimension), 1, f);
+    fwrite(&abbrev, 1, 1, f);
+
+    for (uint32_t i = 0; i < num_bins; i++)
+    {
+        uint16_t count = (uint16_t)((i * 7) % 5);
+        fwrite(&count, sizeof(count), 1, f);
+    }
+
+    // chain of calls, one of them repeated, and one arc to unknown callee, which is not written back
+    for (uint32_t i = 0; i < ROUNDTRIP_FUNCTION_COUNT; i++)
+    {
+        bfd_vma frompc = (bfd_vma)functions[i].address + 1;
+        bfd_vma selfpc = (bfd_vma)functions[i + 1].address;
+        uint32_t count = (i == 3) ? 1 : i + 1;
+
+        for (int repeat = 0; repeat < ((i == 3) ? 2 : 1); repeat++)
+        {
+            fputc(GMON_TAG_CG_ARC, f);
+            fwrite(&frompc, sizeof(frompc), 1, f);
+            fwrite(&selfpc, sizeof(selfpc), 1, f);
+            fwrite(&count, sizeof(count), 1, f);
+        }
+    }
+
+    bfd_vma frompc = (bfd_vma)functions[0].address;
+    bfd_vma selfpc = 1;
+    uint32_t count = 5;
+    fputc(GMON_TAG_CG_ARC, f);
+    fwrite(&frompc, sizeof(frompc), 1, f);
+    fwrite(&selfpc, sizeof(selfpc), 1, f);
+    fwrite(&count, sizeof(count), 1, f);
+
+    return fclose(f) == 0;
+}
+
+// compares all tables of two loads
+static void CompareLoads(GmonFile* a, GmonFile* b)
+{
+    std::vector<FunctionEntry> functionsA, functionsB;
+    a->FillFunctionTable(functionsA);
+    b->FillFunctionTable(functionsB);
+
+    TEST_CHECK(functionsA.size() == functionsB.size());
+    for (size_t i = 0; i < functionsA.size() && i < functionsB.size(); i++)
+        TEST_CHECK(functionsA[i].address == functionsB[i].address && functionsA[i].name == functionsB[i].name);
+
+    std::vector<FlatProfileRecord> flatA, flatB;
+    a->FillFlatProfileTable(flatA);
+    b->FillFlatProfileTable(flatB);
+
+    TEST_CHECK(flatA.size() == flatB.size());
+    for (size_t i = 0; i < flatA.size() && i < flatB.size(); i++)
+    {
+        TEST_CHECK(flatA[i].functionId == flatB[i].functionId);
+        TEST_CHECK(flatA[i].callCount == flatB[i].callCount);
+        TEST_CHECK(flatA[i].timeTotal == flatB[i].timeTotal);
+    }
+
+    CallGraphMap graphA, graphB;
+    a->FillCallGraphMap(graphA);
+    b->FillCallGraphMap(graphB);
+    TEST_CHECK(graphA == graphB);
+
+    for (uint32_t i = 0; i < functionsA.size(); i++)
+    {
+        std::vector<callsite_arc> sitesA, sitesB;
+        a->GetCallSitesByCaller(i, sitesA);
+        b->GetCallSitesByCaller(i, sitesB);
+
+        TEST_CHECK(sitesA.size() == sitesB.size());
+        for (size_t j = 0; j < sitesA.size() && j < sitesB.size(); j++)
+        {
+            TEST_CHECK(sitesA[j].callee == sitesB[j].callee);
+            TEST_CHECK(sitesA[j].offset == sitesB[j].offset);
+            TEST_CHECK(sitesA[j].count == sitesB[j].count);
+        }
+    }
+}
+
+// compares contents of two files
+static bool SameFiles(const char* first, const char* second)
+{
+    FILE* a = fopen(first, "rb");
+    FILE* b = fopen(second, "rb");
+    bool same = (a && b);
+
+    while (same)
+    {
+        int ca = fgetc(a), cb = fgetc(b);
+        same = (ca == cb);
+        if (ca == EOF || cb == EOF)
+            break;
+    }
+
+    if (a)
+        fclose(a);
+    if (b)
+        fclose(b);
+
+    return same;
+}
+
+// loads generated profile, writes it back, loads written one and compares the tables; the test binary itself
+// serves as the profiled binary
+int main(int argc, char** argv)
+{
+    if (argc < 3)
+    {
+        fprintf(stderr, "Usage: %s <binary> <output directory>\n", argv[0]);
+        return 2;
+    }
+
+    RegisterLogger(TestLogger);
+
+    std::string dir = argv[2];
+    std::string source = dir + "/roundtrip-source.out";
+    std::string written = dir + "/roundtrip-written.out";
+    std::string rewritten = dir + "/roundtrip-rewritten.out";
+
+    std::shared_ptr<const SymbolTable> symbols = SymbolTableRegistry::GetInstance().Acquire(argv[1], nullptr, nullptr);
+    if (!symbols || !WriteSourceGmon(source.c_str(), *symbols))
+    {
+        fprintf(stderr, "Could not generate source gmon file from symbols of %s\n", argv[1]);
+        return 1;
+    }
+
+    GmonFile* loaded = GmonFile::Load(source.c_str(), argv[1]);
+    TEST_CHECK(loaded != nullptr);
+    if (!loaded)
+        return TestResult();
+
+    // there has to be something to compare
+    std::vector<FlatProfileRecord> sparse;
+    CallGraphMap graph;
+    loaded->FillSparseFlatProfileTable(sparse);
+    loaded->FillCallGraphMap(graph);
+    TEST_CHECK(!sparse.empty());
+    TEST_CHECK(!graph.empty());
+
+    TEST_CHECK(loaded->WriteGmon(written.c_str()));
+
+    GmonFile* reloaded = GmonFile::Load(written.c_str(), argv[1]);
+    TEST_CHECK(reloaded != nullptr);
+    if (reloaded)
+    {
+        CompareLoads(loaded, reloaded);
+
+        // written profile is already merged, so writing it again gives the same file
+        TEST_CHECK(reloaded->WriteGmon(rewritten.c_str()));
+        TEST_CHECK(SameFiles(written.c_str(), rewritten.c_str()));
+    }
+
+    // arcs streamed through the smallest memory budget end up in the same tables
+    GmonFile* budgeted = GmonFile::Load(source.c_str(), argv[1], nullptr, nullptr, 1);
+    TEST_CHECK(budgeted != nullptr);
+    if (budgeted)
+        CompareLoads(loaded, budgeted);
+
+    delete budgeted;
+    delete reloaded;
+    delete loaded;
+
+    return TestResult();
+}
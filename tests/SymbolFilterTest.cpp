@@ -0,0 +1,100 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#include "General.h"
+#include "SymbolFilter.h"
+#include "TestCommon.h"
+
+extern "C" void RegisterLogger(void(*log)(int, const char*, ...));
+
+// does filter accept the name?
+static bool Accepts(const SymbolFilter &filter, const char* name)
+{
+    return filter.Accepts(name, strlen(name));
+}
+
+// parses valid specifications and checks normalized rules and matching
+static void TestValidSpecs()
+{
+    SymbolFilter filter;
+
+    // empty specification and empty rules are fine
+    TEST_CHECK(filter.Parse(""));
+    TEST_CHECK(filter.IsEmpty());
+    TEST_CHECK(filter.Parse(";;\n"));
+    TEST_CHECK(filter.IsEmpty());
+    TEST_CHECK(Accepts(filter, "anything"));
+
+    // rules separated by both ';' and newline; the signature lists them one per line
+    TEST_CHECK(filter.Parse("+prefix:ns::;-glob:ns::*Test*\n-regex:^ns::detail::"));
+    TEST_CHECK(!filter.IsEmpty());
+    TEST_CHECK(filter.GetSignature() == "+prefix:ns::\n-glob:ns::*Test*\n-regex:^ns::detail::\n");
+
+    // include rules limit the loaded symbols, exclude rules win over them
+    TEST_CHECK(Accepts(filter, "ns::run()"));
+    TEST_CHECK(!Accepts(filter, "other::run()"));
+    TEST_CHECK(!Accepts(filter, "ns::MyTestCase::run()"));
+    TEST_CHECK(!Accepts(filter, "ns::detail::helper()"));
+
+    // pattern may contain the separator of kind and pattern
+    filter.Clear();
+    TEST_CHECK(filter.IsEmpty());
+    TEST_CHECK(filter.Parse("-glob:std::?*"));
+    TEST_CHECK(!Accepts(filter, "std::sort()"));
+    TEST_CHECK(Accepts(filter, "std::"));
+    TEST_CHECK(Accepts(filter, "main"));
+
+    // the same rules give the same signature, so the filtered symbol tables could be shared
+    SymbolFilter other;
+    TEST_CHECK(other.Parse("-glob:std::?*;"));
+    TEST_CHECK(other.GetSignature() == filter.GetSignature());
+}
+
+// malformed specifications are refused
+static void TestInvalidSpecs()
+{
+    static const char* invalid[] = {
+        "prefix:ns::",      // missing action
+        "*glob:ns::",       // unknown action
+        "+ns::run",         // missing kind
+        "+suffix:run",      // unknown kind
+        "+regex:(unclosed", // invalid expression
+        "+prefix:ns::;bad", // valid rule followed by invalid one
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        SymbolFilter filter;
+        if (filter.Parse(invalid[i]))
+            fprintf(stderr, "Specification '%s' was accepted\n", invalid[i]);
+        TEST_CHECK(!filter.Parse(invalid[i]));
+    }
+}
+
+int main()
+{
+    RegisterLogger(TestLogger);
+
+    TestValidSpecs();
+    TestInvalidSpecs();
+
+    return TestResult();
+}
@@ -0,0 +1,58 @@
+/**
+ * Copyright (C) 2016 Martin Ubl <http://pivo.kennny.cz>
+ *
+ * This file is part of PIVO gprof input module.
+ *
+ * PIVO gprof input module is free software: you can redistribute it
+ * and/or modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, either version 3 of
+ * the License, or (at your option) any later version.
+ *
+ * PIVO gprof input module is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY; without even the implied warranty
+ * of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with PIVO gprof input module. If not,
+ * see <http://www.gnu.org/licenses/>.
+ **/
+
+
+#ifndef PIVO_GPROF_MODULE_TEST_COMMON_H
+#define PIVO_GPROF_MODULE_TEST_COMMON_H
+
+#include <stdio.h>
+#include <stdarg.h>
+
+#include "Log.h"
+
+// count of failed checks of current test
+static int TestFailures = 0;
+
+// checks condition, reports failed one and continues, so all failures of the test are listed
+#define TEST_CHECK(cond) do { if (!(cond)) { fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); TestFailures++; } } while (0)
+
+// module logger is set by core; tests print errors only
+static void TestLogger(int level, const char* format, ...)
+{
+    if (level != LOG_ERROR)
+        return;
+
+    va_list args;
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    fprintf(stderr, "\n");
+    va_end(args);
+}
+
+// exit code of test
+static int TestResult()
+{
+    if (TestFailures > 0)
+        fprintf(stderr, "%d check(s) failed\n", TestFailures);
+
+    return TestFailures > 0 ? 1 : 0;
+}
+
+#endif